@@ -0,0 +1,25 @@
+#ifndef COBRA_AFFINITY_HH
+#define COBRA_AFFINITY_HH
+
+#include <string_view>
+#include <vector>
+
+namespace cobra {
+
+	// highest cpu number accepted in a cpu list
+	constexpr unsigned max_cpu = 4095;
+
+	// Parses a list in the format of taskset -c and /sys/devices/system/cpu/online, e.g. "0-3,8,10-11". The cpus
+	// keep the order they were listed in. Throws std::invalid_argument when the list is malformed, a cpu is larger
+	// than max_cpu or listed twice.
+	std::vector<unsigned> parse_cpu_list(std::string_view list);
+
+	// pins the calling thread to cpu
+	void pin_thread(unsigned cpu);
+
+	// Makes the calling thread allocate memory from the NUMA node it runs on, so that everything a pinned reactor
+	// sets up after this stays close to it. Does nothing on kernels without NUMA support.
+	void use_local_memory();
+} // namespace cobra
+
+#endif
@@ -3,7 +3,10 @@
 
 #include "cobra/print.hh"
 
+#include <charconv>
+#include <concepts>
 #include <string_view>
+#include <optional>
 #include <ranges>
 #include <format>
 #include <vector>
@@ -33,6 +36,39 @@ namespace cobra {
 		}
 	};
 
+	template <std::integral Result>
+	class parse_conv<Result> {
+	public:
+		using result_type = Result;
+
+		template <std::input_iterator I, std::sentinel_for<I> S>
+		result_type convert(I& begin, S end, const char* name) const {
+			if (begin == end) {
+				throw argument_error(std::format("argument missing parameter: {}", name));
+			}
+
+			std::string_view str = static_cast<std::string_view>(*begin++);
+			Result value;
+			auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+
+			if (ec != std::errc() || ptr != str.data() + str.size()) {
+				throw argument_error(std::format("not a valid number for {}: {}", name, str));
+			}
+			return value;
+		}
+	};
+
+	template <std::integral Result>
+	class parse_conv<std::optional<Result>> {
+	public:
+		using result_type = std::optional<Result>;
+
+		template <std::input_iterator I, std::sentinel_for<I> S>
+		result_type convert(I& begin, S end, const char* name) const {
+			return parse_conv<Result>().convert(begin, end, name);
+		}
+	};
+
 	template <class Result>
 	class store_conv {
 		Result _value;
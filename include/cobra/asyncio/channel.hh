@@ -0,0 +1,186 @@
+#ifndef COBRA_ASYNCIO_CHANNEL_HH
+#define COBRA_ASYNCIO_CHANNEL_HH
+
+#include "cobra/asyncio/event.hh"
+#include "cobra/asyncio/stop_registration.hh"
+#include "cobra/asyncio/task.hh"
+#include "cobra/exception.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <stop_token>
+#include <utility>
+
+namespace cobra {
+
+	// Bounded queue between one producing and one consuming coroutine. Values are moved through a ring of capacity
+	// slots, so a channel of buffers hands over whole chunks without copying them. send waits while the ring is
+	// full, which slows the producer down to the pace of the consumer, and recv waits while it is empty. Neither side
+	// takes a lock: each side parks at most one waiter in its own slot and whoever swaps a waiter out of a slot
+	// wakes it up. After close, send drops its value and returns false and recv drains what is left before it
+	// returns std::nullopt. Both wait with an optional stop token and throw cancelled_exception when it is stopped.
+	template <class T>
+	class async_channel {
+		enum class side {
+			sender,
+			receiver,
+		};
+
+		struct waiter_canceller {
+			std::atomic<event_handle<void>*>* _slot;
+			event_handle<void>* _handle;
+
+			void operator()() const noexcept {
+				event_handle<void>* expected = _handle;
+
+				// a waker that got there first resumes the waiter instead
+				if (_slot->compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel))
+					_handle->set_exception(std::make_exception_ptr(cancelled_exception()));
+			}
+		};
+
+		struct wait_event {
+			async_channel* _channel;
+			side _side;
+			std::stop_token _token;
+			stop_registration<waiter_canceller> _cancel;
+
+			void operator()(event_handle<void>& handle) {
+				std::atomic<event_handle<void>*>& slot = _channel->slot(_side);
+
+				if (_token.stop_requested()) {
+					handle.set_exception(std::make_exception_ptr(cancelled_exception()));
+					return;
+				}
+
+				slot.store(&handle, std::memory_order_seq_cst);
+				// pairs with the fence in wake, either the other side sees the waiter or we see its progress
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+
+				if (_channel->can_proceed(_side)) {
+					if (slot.exchange(nullptr, std::memory_order_acq_rel))
+						handle.set_value();
+					return;
+				}
+
+				if (_token.stop_possible())
+					_cancel.arm(_token, waiter_canceller{&slot, &handle});
+			}
+		};
+
+		std::size_t _capacity;
+		std::unique_ptr<std::optional<T>[]> _slots;
+		alignas(64) std::atomic<std::size_t> _head = 0;
+		alignas(64) std::atomic<std::size_t> _tail = 0;
+		std::atomic<bool> _closed = false;
+		std::atomic<event_handle<void>*> _sender = nullptr;
+		std::atomic<event_handle<void>*> _receiver = nullptr;
+
+		inline std::atomic<event_handle<void>*>& slot(side which) noexcept {
+			return which == side::sender ? _sender : _receiver;
+		}
+
+		bool can_proceed(side which) const noexcept {
+			if (_closed.load(std::memory_order_acquire))
+				return true;
+
+			const std::size_t head = _head.load(std::memory_order_acquire);
+			const std::size_t tail = _tail.load(std::memory_order_acquire);
+
+			if (which == side::sender)
+				return tail - head < _capacity;
+			return tail != head;
+		}
+
+		void wake(side which) noexcept {
+			std::atomic<event_handle<void>*>& waiter = slot(which);
+
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (!waiter.load(std::memory_order_relaxed))
+				return;
+			if (event_handle<void>* handle = waiter.exchange(nullptr, std::memory_order_acq_rel))
+				handle->set_value();
+		}
+
+		// moves value in if there is room, producer only
+		bool try_push(T& value) {
+			const std::size_t tail = _tail.load(std::memory_order_relaxed);
+
+			if (tail - _head.load(std::memory_order_acquire) >= _capacity)
+				return false;
+
+			_slots[tail % _capacity].emplace(std::move(value));
+			_tail.store(tail + 1, std::memory_order_release);
+			wake(side::receiver);
+			return true;
+		}
+
+		// consumer only
+		std::optional<T> try_pop() {
+			const std::size_t head = _head.load(std::memory_order_relaxed);
+
+			if (head == _tail.load(std::memory_order_acquire))
+				return std::nullopt;
+
+			std::optional<T> value = std::move(_slots[head % _capacity]);
+			_slots[head % _capacity].reset();
+			_head.store(head + 1, std::memory_order_release);
+			wake(side::sender);
+			return value;
+		}
+
+		event<void, wait_event> wait(side which, std::stop_token token) {
+			return {{this, which, std::move(token), {}}};
+		}
+
+	public:
+		explicit async_channel(std::size_t capacity) : _capacity(capacity), _slots(new std::optional<T>[capacity]) {
+			if (capacity == 0)
+				throw std::invalid_argument("an async_channel needs room for at least one value");
+		}
+
+		async_channel(const async_channel& other) = delete;
+
+		task<bool> send(T value, std::stop_token token = {}) {
+			while (!_closed.load(std::memory_order_acquire)) {
+				if (try_push(value))
+					co_return true;
+				co_await wait(side::sender, token);
+			}
+			co_return false;
+		}
+
+		task<std::optional<T>> recv(std::stop_token token = {}) {
+			while (true) {
+				// looked at before popping, so that values sent before close are still delivered
+				const bool closed = _closed.load(std::memory_order_acquire);
+				std::optional<T> value = try_pop();
+
+				if (value || closed)
+					co_return value;
+				co_await wait(side::receiver, token);
+			}
+		}
+
+		// may be called from either side, wakes up whoever is waiting
+		void close() noexcept {
+			_closed.store(true, std::memory_order_seq_cst);
+			wake(side::sender);
+			wake(side::receiver);
+		}
+
+		inline bool closed() const noexcept {
+			return _closed.load(std::memory_order_acquire);
+		}
+
+		inline std::size_t capacity() const noexcept {
+			return _capacity;
+		}
+	};
+} // namespace cobra
+
+#endif
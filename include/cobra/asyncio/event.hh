@@ -3,23 +3,47 @@
 
 #include "cobra/asyncio/result.hh"
 
+#include <atomic>
 #include <coroutine>
 
 namespace cobra {
 	template <class T>
 	class event_handle_base {
 	protected:
-		std::coroutine_handle<T> _next;
+		std::coroutine_handle<> _next;
 		result<T> _result;
+		// set by whichever of the waiter and the completer gets there first, the other one resumes the waiter
+		std::atomic_flag _flag;
+
+		bool complete() noexcept {
+			return _flag.test_and_set(std::memory_order_acq_rel);
+		}
 
 	public:
 		void set_next(std::coroutine_handle<> handle) noexcept {
 			_next = handle;
 		}
 
+		// true if the result is already there and the waiter should not suspend after all
+		bool suspend() noexcept {
+			return _flag.test_and_set(std::memory_order_acq_rel);
+		}
+
 		void set_exception(std::exception_ptr exception) noexcept {
 			_result.set_exception(exception);
-			_next.resume();
+
+			if (complete())
+				_next.resume();
+		}
+
+		// stores the exception and hands the waiting coroutine to exec instead of resuming it here, args (like a
+		// priority) are passed on to exec.schedule
+		template <class Executor, class... Args>
+		void set_exception(std::exception_ptr exception, Executor& exec, Args... args) {
+			_result.set_exception(exception);
+
+			if (complete())
+				exec.schedule(_next, args...);
 		}
 
 		T value() {
@@ -32,7 +56,17 @@ namespace cobra {
 	public:
 		void set_value(T value) {
 			event_handle_base<T>::_result.set_value(std::move(value));
-			event_handle_base<T>::_next.resume();
+
+			if (event_handle_base<T>::complete())
+				event_handle_base<T>::_next.resume();
+		}
+
+		template <class Executor, class... Args>
+		void set_value(T value, Executor& exec, Args... args) {
+			event_handle_base<T>::_result.set_value(std::move(value));
+
+			if (event_handle_base<T>::complete())
+				exec.schedule(event_handle_base<T>::_next, args...);
 		}
 	};
 
@@ -41,7 +75,17 @@ namespace cobra {
 	public:
 		void set_value() noexcept {
 			_result.set_value();
-			_next.resume();
+
+			if (complete())
+				_next.resume();
+		}
+
+		template <class Executor, class... Args>
+		void set_value(Executor& exec, Args... args) {
+			_result.set_value();
+
+			if (complete())
+				exec.schedule(_next, args...);
 		}
 	};
 
@@ -59,9 +103,15 @@ namespace cobra {
 			return false;
 		}
 
-		void await_suspend(std::coroutine_handle<> handle) noexcept {
+		// an event that completes while it is being scheduled transfers straight back instead of resuming the
+		// waiter from inside _function
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept {
 			_handle.set_next(handle);
 			_function(_handle);
+
+			if (_handle.suspend())
+				return handle;
+			return std::noop_coroutine();
 		}
 
 		T await_resume() {
@@ -3,21 +3,28 @@
 
 #include "cobra/asyncio/event.hh"
 #include "cobra/asyncio/executor.hh"
-#include "cobra/asyncio/generator.hh"
+#include "cobra/asyncio/fd_table.hh"
+#include "cobra/asyncio/stats.hh"
+#include "cobra/asyncio/stop_registration.hh"
 #include "cobra/asyncio/task.hh"
+#include "cobra/asyncio/timer.hh"
 #include "cobra/file.hh"
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <exception>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
-#include <unordered_map>
+#include <stop_token>
+#include <vector>
 
 extern "C" {
 #include <sys/epoll.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 }
 
@@ -35,34 +42,124 @@ namespace cobra {
 		using event_pair = std::pair<int, poll_type>;
 
 	protected:
+		// takes a wait back out of the loop when its stop_token is stopped
+		struct event_canceller {
+			event_loop* _loop;
+			event_pair _event;
+			event_handle<void>* _handle;
+
+			void operator()() const noexcept;
+		};
+
 		struct event_loop_event {
 			std::reference_wrapper<event_loop> _loop;
 			event_pair _event;
 			std::optional<std::chrono::milliseconds> _timeout;
+			std::stop_token _token;
+			stop_registration<event_canceller> _cancel;
+
+			void operator()(event_handle<void>& handle);
+		};
+
+		// timer for loops that keep their timeouts in a timer_wheel
+		struct loop_timer : timer_node {
+			event_handle<void>* handle = nullptr;
+			// the wait that is timed out, empty for sleeps
+			std::optional<event_pair> event;
+		};
+
+		struct sleep_event {
+			std::reference_wrapper<event_loop> _loop;
+			std::chrono::steady_clock::time_point _deadline;
+			loop_timer _timer;
 
 			void operator()(event_handle<void>& handle);
 		};
 
+		// the coroutine must only ever be resumed by the loop, so this is a plain awaitable instead of an event
+		struct post_event : task_node {
+			std::reference_wrapper<event_loop> _loop;
+			std::coroutine_handle<> _handle;
+
+			post_event(event_loop& loop);
+
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle);
+
+			void await_resume() const noexcept {
+				return;
+			}
+		};
+
 	public:
 		using event_type = event<void, event_loop_event>;
+		using sleep_type = event<void, sleep_event>;
+		using post_type = post_event;
 
+		event_loop();
+		event_loop(const event_loop& other) = delete;
 		virtual ~event_loop();
 
+		// Once token is stopped, a pending wait is taken out of the loop and throws cancelled_exception. A wait that
+		// already completed is not affected.
 		event_type wait_ready(poll_type type, const file& fd,
-							  std::optional<std::chrono::milliseconds> timeout = std::nullopt);
-		event_type wait_read(const file& fd, std::optional<std::chrono::milliseconds> timeout = std::nullopt);
-		event_type wait_write(const file& fd, std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+							  std::optional<std::chrono::milliseconds> timeout = std::nullopt, std::stop_token token = {});
+		event_type wait_read(const file& fd, std::optional<std::chrono::milliseconds> timeout = std::nullopt,
+							 std::stop_token token = {});
+		event_type wait_write(const file& fd, std::optional<std::chrono::milliseconds> timeout = std::nullopt,
+							  std::stop_token token = {});
 
+		// reaps a child without blocking the loop, a child that is still running after timeout is killed with SIGKILL.
+		// Returns the exit status, or 128 plus the signal if the child was killed by one.
 		task<int> wait_pid(int pid, std::optional<std::chrono::milliseconds> timeout = std::nullopt);
 
+		sleep_type sleep_for(std::chrono::milliseconds duration);
+		sleep_type sleep_until(std::chrono::steady_clock::time_point deadline);
+
+		// Completion style socket operations. The default implementations wait for readiness and then perform the
+		// syscall, loops that can submit the operation itself (io_uring) override these.
+		virtual task<std::size_t> recv(const file& fd, char* data, std::size_t size, std::stop_token token = {});
+		virtual task<std::size_t> send(const file& fd, const char* data, std::size_t size, std::stop_token token = {});
+		virtual task<file> accept(const file& fd);
+		virtual task<bool> connect(const file& fd, const sockaddr* addr, socklen_t len);
+
+		// Runs node on the loop thread during one of the next calls to poll(), may be called from any thread. The
+		// loop is woken up if it is blocked, so node runs even if no fd becomes ready.
+		void post(task_node& node);
+		// resumes the awaiting coroutine on the loop thread
+		post_type post_to_loop();
+
 		virtual void poll() = 0;
 
+	protected:
+		// eventfd that is signalled when work is posted to an empty inbox, loops have to watch it for reads and call
+		// run_posted once it is readable
+		const file& wakeup_fd() const;
+		void run_posted();
+
 	private:
+		file _wakeup;
+		// lock free stack of posted nodes, newest first
+		std::atomic<task_node*> _posted = nullptr;
+
 		virtual void schedule_event(event_pair event, std::optional<std::chrono::milliseconds> timeout,
 									event_type::handle_type& handle) = 0;
+		virtual void schedule_sleep(std::chrono::steady_clock::time_point deadline, loop_timer& timer,
+									event_type::handle_type& handle) = 0;
+		// completes handle with cancelled_exception if it is still waiting for event, may be called from any thread
+		virtual void cancel_event(event_pair event, event_type::handle_type& handle) noexcept = 0;
+		// called for every fd that is waited on, before the wait is scheduled
+		virtual void register_file(const file& fd);
 	};
 
-	class epoll_event_loop : public event_loop {
+	// fds are added to the epoll set the first time they are waited on, in edge triggered mode for both directions,
+	// and stay there until the file is closed. Edges that arrive without a waiter are remembered so a later wait
+	// completes without a syscall. Because of this, callers must only wait after an operation returned EAGAIN.
+	// Waiters live in an fd_table, registering and waking them only takes a lock when a timeout is involved.
+	class epoll_event_loop : public event_loop, private file_observer {
 	public:
 		using clock = std::chrono::steady_clock;
 		using future_type = event_handle<void>;
@@ -74,46 +171,108 @@ namespace cobra {
 		std::mutex _mutex;
 		std::reference_wrapper<executor> _exec;
 
-		struct timed_future {
-			std::reference_wrapper<future_type> future;
-			std::optional<time_point> timeout;
+		// State of one direction of a slot: idle, ready when an edge came in while nobody was waiting, or the address
+		// of the waiting handle. Waits with a timeout tag the address with timed_tag and keep their loop_timer in the
+		// slot. Whoever manages to swap a handle out of the state owns waking it up.
+		using slot_state = std::uintptr_t;
+
+		static constexpr slot_state idle_state = 0;
+		static constexpr slot_state ready_state = 1;
+		static constexpr slot_state timed_tag = 2;
+		static constexpr slot_state state_tag_mask = 3;
+
+		struct slot {
+			std::atomic<slot_state> read = idle_state;
+			std::atomic<slot_state> write = idle_state;
+			std::atomic<bool> registered = false;
+			// guarded by _mutex like the rest of the timer_wheel
+			loop_timer read_timer;
+			loop_timer write_timer;
+
+			inline std::atomic<slot_state>& state(poll_type type) {
+				return type == poll_type::read ? read : write;
+			}
+
+			inline loop_timer& timer(poll_type type) {
+				return type == poll_type::read ? read_timer : write_timer;
+			}
 		};
 
-		std::unordered_map<int, timed_future> _write_events;
-		std::unordered_map<int, timed_future> _read_events;
+		fd_table<slot> _slots;
+		timer_wheel _timers;
+
+	public:
+		// times are in nanoseconds
+		struct poll_stats {
+			std::uint64_t waits = 0;
+			std::uint64_t events = 0;
+			// time spent inside epoll_wait
+			histogram_snapshot wait_time;
+			histogram_snapshot events_per_batch;
+			// from epoll_wait returning to the waiter being handed to the executor
+			histogram_snapshot lag;
 
-		using event_list = std::vector<event_pair>;
+			inline double events_per_wait() const {
+				return waits == 0 ? 0.0 : static_cast<double>(events) / static_cast<double>(waits);
+			}
+
+			poll_stats& operator+=(const poll_stats& other) noexcept;
+		};
+
+		static constexpr std::size_t min_events = 16;
+		static constexpr std::size_t default_max_events = 1024;
+
+	private:
+		// Reused by every epoll_wait. It doubles whenever a wait fills it up, and halves after shrink_after waits in a
+		// row that used less than a quarter of it, but always stays between min_events and _max_events.
+		std::vector<epoll_event> _events;
+		std::size_t _max_events;
+		std::size_t _underused = 0;
+
+		// written by the polling thread only
+		struct poll_counters {
+			stat_counter waits;
+			stat_counter events;
+			stat_histogram wait_time;
+			stat_histogram events_per_batch;
+			stat_histogram lag;
+		};
+
+		poll_counters _counters;
+
+		static constexpr std::size_t shrink_after = 64;
 
 	public:
-		epoll_event_loop(executor& exec);
+		epoll_event_loop(executor& exec, std::size_t max_events = default_max_events);
 		epoll_event_loop(const epoll_event_loop& other) = delete;
-		epoll_event_loop(epoll_event_loop&& other) noexcept;
 
 		void poll() override;
 
+		// may be called from any thread
+		poll_stats stats() const;
+
 	private:
 		void schedule_event(event_pair event, std::optional<std::chrono::milliseconds> timeout,
 							event_type::handle_type& handle) override;
+		void schedule_sleep(time_point deadline, loop_timer& timer, event_type::handle_type& handle) override;
+		void cancel_event(event_pair event, event_type::handle_type& handle) noexcept override;
+		void register_file(const file& fd) override;
+		void file_closed(int fd) noexcept override;
 
-		std::vector<epoll_event> epoll(std::size_t count, std::optional<clock::duration> timeout);
-		static generator<std::pair<int, poll_type>> convert(epoll_event event);
-		event_list poll(std::size_t count, std::optional<clock::duration> timeout);
-
-		std::optional<std::reference_wrapper<future_type>> remove_event(event_pair event);
-		void add_event(event_pair event, std::optional<clock::duration> timeout, future_type& future);
-
-		void remove_before(std::unordered_map<int, timed_future>& map, time_point point);
-		void remove_before(time_point point);
-		std::optional<time_point> get_timeout(const std::unordered_map<int, timed_future>& map);
-		std::optional<time_point> get_timeout();
+		// fills the front of _events, returns how many events there are
+		std::size_t epoll(std::optional<clock::duration> timeout);
+		void resize_events(std::size_t count);
+		// wakes up the waiters of one event, without allocating. ready is when epoll_wait returned it.
+		void dispatch(const epoll_event& event, time_point ready);
 
-		inline std::unordered_map<int, timed_future>& get_map(poll_type type) {
-			return type == poll_type::read ? _read_events : _write_events;
-		}
+		// the waiter for type, or nullptr after remembering the edge
+		future_type* take_waiter(slot& slot, poll_type type);
+		// disarms the timer of a handle that was swapped out of a timed state
+		void cancel_timer(slot& slot, poll_type type, future_type* handle);
+		bool add_event(event_pair event, std::optional<clock::duration> timeout, future_type& future);
 
-		static inline uint32_t event_to_epoll(poll_type type) {
-			return type == poll_type::read ? EPOLLIN : EPOLLOUT;
-		}
+		// null exception for sleeps that are done
+		std::vector<std::pair<std::reference_wrapper<future_type>, std::exception_ptr>> expire(time_point now);
 	};
 } // namespace cobra
 
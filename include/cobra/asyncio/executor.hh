@@ -3,52 +3,188 @@
 
 #include "cobra/asyncio/async_task.hh"
 #include "cobra/asyncio/event.hh"
+#include "cobra/asyncio/stats.hh"
+#include "cobra/asyncio/work_stealing_deque.hh"
 
+#include <array>
+#include <atomic>
 #include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
 #include <functional>
-#include <queue>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
 namespace cobra {
+	// Which lane of the executor a function goes into. io is for resuming coroutines whose I/O or accept completed,
+	// normal for request handling and bulk for CPU heavy work like compression that may wait its turn. Executors
+	// that run everything right away ignore it.
+	enum class priority {
+		io,
+		normal,
+		bulk,
+	};
+
+	// intrusive unit of work for executor::schedule. The executor never copies or frees it, so it has to stay alive
+	// until it ran. Meant to be embedded in whatever the function operates on.
+	class task_node {
+		friend class event_loop;
+
+		void (*_function)(task_node& node);
+		// link for the event_loop's inbox, the executors keep their own queues
+		task_node* _next = nullptr;
+
+	public:
+		explicit task_node(void (*function)(task_node& node)) noexcept : _function(function) {}
+
+		inline void run() {
+			_function(*this);
+		}
+	};
+
 	class executor {
 	protected:
+		// not an event, which would let the awaiting coroutine carry on inline when the executor happens to run the
+		// continuation before the coroutine finished suspending
 		struct executor_event {
 			std::reference_wrapper<executor> _exec;
+			priority _priority;
 
-			void operator()(event_handle<void>& handle);
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle);
+
+			void await_resume() const noexcept {
+				return;
+			}
 		};
 
 	public:
-		using event_type = event<void, executor_event>;
+		using event_type = executor_event;
 
 		virtual ~executor();
 
-		event_type schedule();
+		// co_await schedule(priority::bulk) moves the rest of a coroutine into the bulk lane
+		event_type schedule(priority prio = priority::normal);
 
 		template <class Awaitable>
-		auto schedule(Awaitable awaitable) -> async_task<decltype(awaitable.await_resume())> {
-			co_await schedule();
+		auto schedule(Awaitable awaitable, priority prio = priority::normal)
+			-> async_task<decltype(awaitable.await_resume())> {
+			co_await schedule(prio);
 			co_return co_await awaitable;
 		}
 
-		virtual void schedule(std::function<void()> func) = 0;
+		virtual void schedule(std::function<void()> func, priority prio = priority::normal) = 0;
+		// neither of these allocate, prefer them over the std::function overload on hot paths
+		virtual void schedule(std::coroutine_handle<> handle, priority prio = priority::normal) = 0;
+		virtual void schedule(task_node& node, priority prio = priority::normal) = 0;
 	};
 
 	class sequential_executor : public executor {
 	public:
 		using executor::schedule;
 
-		virtual void schedule(std::function<void()> func) override;
+		virtual void schedule(std::function<void()> func, priority prio = priority::normal) override;
+		virtual void schedule(std::coroutine_handle<> handle, priority prio = priority::normal) override;
+		virtual void schedule(task_node& node, priority prio = priority::normal) override;
 	};
 
+	// totals over all workers of a thread_pool_executor, times are in nanoseconds
+	struct executor_stats {
+		std::uint64_t tasks = 0;
+		std::uint64_t steals = 0;
+		// how often a sleeping worker was woken up
+		std::uint64_t wakeups = 0;
+		// functions scheduled from outside the pool
+		std::uint64_t injected = 0;
+		histogram_snapshot run_time;
+		// work that was waiting in the picking worker's lanes and the injection queues whenever a worker picked
+		histogram_snapshot queue_depth;
+	};
+
+	// Work stealing pool. Every worker owns a deque and a LIFO slot that holds the function it scheduled last, so
+	// that a continuation runs right after the function that scheduled it. After lifo_budget picks in a row from the
+	// slot, its function goes to the deque and the injection queue gets a turn, so a chain of continuations can not
+	// keep work scheduled from outside the pool waiting. Functions scheduled from outside the pool go through a
+	// shared injection queue. Idle workers steal from each other and spin for a while before
+	// they go to sleep, and schedule only takes the sleep mutex when somebody is actually sleeping.
+	//
+	// Every priority gets its own deques and injection queue. A worker looks for io work first, but every
+	// normal_interval-th pick starts at the normal lane and every bulk_interval-th pick at the bulk lane, so a flood
+	// of wakeups slows lower lanes down without starving them. Bulk work never takes the LIFO slot.
 	class thread_pool_executor : public executor {
+		using job = std::function<void()>;
+
+		// queues hold tagged words: a heap allocated job, a coroutine handle or a task_node, all at least 4 byte
+		// aligned. 0 means empty.
+		using item = std::uintptr_t;
+
+		static constexpr item job_tag = 0;
+		static constexpr item handle_tag = 1;
+		static constexpr item node_tag = 2;
+		static constexpr item tag_mask = 3;
+
+		static constexpr std::size_t lane_count = 3;
+		static constexpr std::uint32_t normal_interval = 4;
+		static constexpr std::uint32_t bulk_interval = 16;
+		static constexpr std::uint32_t lifo_budget = 3;
+
+		struct worker {
+			thread_pool_executor* pool;
+			std::size_t index;
+			std::array<work_stealing_deque<item>, lane_count> deques;
+			item lifo = 0;
+			priority lifo_priority = priority::normal;
+			// picks in a row that came from the LIFO slot
+			std::uint32_t lifo_streak = 0;
+			std::uint64_t seed;
+			std::uint32_t picks = 0;
+
+			stat_counter tasks;
+			stat_counter steals;
+			stat_counter wakeups;
+			stat_histogram run_time;
+			stat_histogram queue_depth;
+		};
+
+		struct inject_queue {
+			std::mutex mutex;
+			std::deque<item> items;
+			std::atomic<std::size_t> size = 0;
+			// only written with mutex held
+			stat_counter pushed;
+		};
+
+		std::vector<std::unique_ptr<worker>> _workers;
 		std::vector<std::jthread> _threads;
-		std::queue<std::function<void()>> _queue;
-		std::mutex _mutex;
+
+		std::array<inject_queue, lane_count> _inject;
+
+		std::mutex _sleep_mutex;
 		std::condition_variable _condition_variable;
+		std::atomic<std::size_t> _sleepers = 0;
+
+		static constexpr int spin_rounds = 32;
 
 		void create_threads(std::size_t count);
+		void run(worker& self, std::stop_token stop_token);
+
+		void push(item work, priority prio);
+		static void run_item(item work);
+		static void destroy_item(item work);
+
+		item find_item(worker& self);
+		item find_item(worker& self, priority prio);
+		item steal(worker& self, priority prio);
+		item take_injected(priority prio);
+		bool has_stealable_item() const;
+		std::size_t queue_depth(const worker& self) const;
+		void notify_sleeper();
 
 	public:
 		using executor::schedule;
@@ -57,7 +193,12 @@ namespace cobra {
 		thread_pool_executor(std::size_t count);
 		~thread_pool_executor();
 
-		virtual void schedule(std::function<void()> func) override;
+		virtual void schedule(std::function<void()> func, priority prio = priority::normal) override;
+		virtual void schedule(std::coroutine_handle<> handle, priority prio = priority::normal) override;
+		virtual void schedule(task_node& node, priority prio = priority::normal) override;
+
+		// cheap enough to call from any thread at any time, the counters of the workers are only added up here
+		executor_stats stats() const;
 	};
 
 	extern sequential_executor global_executor;
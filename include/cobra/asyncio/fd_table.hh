@@ -0,0 +1,92 @@
+#ifndef COBRA_ASYNCIO_FD_TABLE_HH
+#define COBRA_ASYNCIO_FD_TABLE_HH
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+
+extern "C" {
+#include <sys/resource.h>
+}
+
+namespace cobra {
+
+	// Dense table with one Slot per fd number, indexed directly by the fd. Slots are allocated a chunk at a time the
+	// first time an fd in the chunk is used and stay put until the table is destroyed, so a lookup is two loads and
+	// never takes a lock. Slots have to be default constructible and do their own synchronization.
+	template <class Slot>
+	class fd_table {
+		static constexpr std::size_t chunk_bits = 10;
+		static constexpr std::size_t chunk_size = std::size_t(1) << chunk_bits;
+		// 4M fds, way past any sane RLIMIT_NOFILE, for when the hard limit is unlimited
+		static constexpr std::size_t max_capacity = std::size_t(1) << 22;
+
+		std::size_t _chunk_count;
+		std::unique_ptr<std::atomic<Slot*>[]> _chunks;
+
+	public:
+		fd_table() : fd_table(hard_fd_limit()) {}
+
+		fd_table(std::size_t capacity) {
+			capacity = std::clamp<std::size_t>(capacity, chunk_size, max_capacity);
+			_chunk_count = (capacity + chunk_size - 1) / chunk_size;
+			_chunks.reset(new std::atomic<Slot*>[_chunk_count]);
+
+			for (std::size_t i = 0; i < _chunk_count; ++i)
+				_chunks[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		fd_table(const fd_table& other) = delete;
+
+		~fd_table() {
+			for (std::size_t i = 0; i < _chunk_count; ++i)
+				delete[] _chunks[i].load(std::memory_order_relaxed);
+		}
+
+		// allocates the slot's chunk if needed
+		Slot& operator[](int fd) {
+			std::atomic<Slot*>& chunk = chunk_of(fd);
+			Slot* slots = chunk.load(std::memory_order_acquire);
+
+			if (!slots) {
+				Slot* fresh = new Slot[chunk_size];
+
+				if (chunk.compare_exchange_strong(slots, fresh, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					slots = fresh;
+				} else {
+					// somebody else was first, slots now holds theirs
+					delete[] fresh;
+				}
+			}
+			return slots[fd & (chunk_size - 1)];
+		}
+
+		// nullptr if no fd in the slot's chunk was ever used
+		Slot* find(int fd) const {
+			if (fd < 0 || static_cast<std::size_t>(fd) >= _chunk_count * chunk_size)
+				return nullptr;
+
+			Slot* slots = _chunks[fd >> chunk_bits].load(std::memory_order_acquire);
+			return slots ? &slots[fd & (chunk_size - 1)] : nullptr;
+		}
+
+	private:
+		std::atomic<Slot*>& chunk_of(int fd) {
+			if (fd < 0 || static_cast<std::size_t>(fd) >= _chunk_count * chunk_size)
+				throw std::out_of_range("fd does not fit in the fd_table");
+			return _chunks[fd >> chunk_bits];
+		}
+
+		static std::size_t hard_fd_limit() {
+			rlimit limit;
+
+			if (getrlimit(RLIMIT_NOFILE, &limit) == -1 || limit.rlim_max == RLIM_INFINITY)
+				return max_capacity;
+			return limit.rlim_max;
+		}
+	};
+} // namespace cobra
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef COBRA_ASYNCIO_FRAME_ALLOCATOR_HH
+#define COBRA_ASYNCIO_FRAME_ALLOCATOR_HH
+
+#include <cstddef>
+
+namespace cobra {
+
+	// Recycles coroutine frames through thread local free lists, one per 64 byte size class up to 2048 bytes. Bigger
+	// frames go straight to operator new. A frame freed on another thread than the one that allocated it ends up on
+	// the list of the thread that freed it, every list is capped so memory can not pile up on a single thread.
+	class frame_allocator {
+	public:
+		static constexpr std::size_t granularity = 64;
+		static constexpr std::size_t max_size = 2048;
+		static constexpr std::size_t max_cached = 1024;
+
+		static void* allocate(std::size_t size);
+		static void deallocate(void* ptr, std::size_t size) noexcept;
+
+		// number of frames allocated on the calling thread so far, including frames that were too big to pool
+		static std::size_t allocated() noexcept;
+	};
+
+	// base of promise types whose frames should come from the frame_allocator
+	class pooled_frame {
+	public:
+		static void* operator new(std::size_t size) {
+			return frame_allocator::allocate(size);
+		}
+
+		static void operator delete(void* ptr, std::size_t size) noexcept {
+			frame_allocator::deallocate(ptr, size);
+		}
+	};
+} // namespace cobra
+
+#endif
@@ -2,6 +2,7 @@
 #define COBRA_ASYNCIO_FUTURE_TASK_HH
 
 #include "cobra/asyncio/coroutine.hh"
+#include "cobra/asyncio/frame_allocator.hh"
 
 #include <future>
 
@@ -49,7 +50,7 @@ namespace cobra {
 	};
 
 	template <class T>
-	class future_task_promise : public future_task_promise_impl<T> {
+	class future_task_promise : public future_task_promise_impl<T>, public pooled_frame {
 	public:
 		future_task<T> get_return_object() noexcept {
 			return {*this};
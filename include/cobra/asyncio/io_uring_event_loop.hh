@@ -0,0 +1,144 @@
+#ifndef COBRA_ASYNCIO_IO_URING_EVENT_LOOP_HH
+#define COBRA_ASYNCIO_IO_URING_EVENT_LOOP_HH
+
+#include "cobra/asyncio/event.hh"
+#include "cobra/asyncio/event_loop.hh"
+#include "cobra/asyncio/executor.hh"
+#include "cobra/asyncio/stop_registration.hh"
+#include "cobra/asyncio/task.hh"
+#include "cobra/file.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+}
+
+namespace cobra {
+
+	// event_loop that submits socket operations to an io_uring instead of waiting for readiness. Submissions are
+	// batched and only handed to the kernel once per poll(), together with reaping all completions.
+	class io_uring_event_loop : public event_loop {
+	public:
+		using clock = std::chrono::steady_clock;
+
+	private:
+		class mapping {
+			void* _ptr;
+			std::size_t _size;
+
+		public:
+			mapping(int fd, std::size_t size, off_t offset);
+			mapping(const mapping& other) = delete;
+			~mapping();
+
+			inline void* get() const {
+				return _ptr;
+			}
+
+			template <class T>
+			inline T* at(std::size_t offset) const {
+				return reinterpret_cast<T*>(static_cast<char*>(_ptr) + offset);
+			}
+		};
+
+		// completions for wait_ready hold an event_handle<void>, every other operation an event_handle<int>. The low
+		// bits of the user_data tell them apart.
+		static constexpr std::uint64_t void_handle_tag = 1;
+		static constexpr std::uint64_t sleep_handle_tag = 2;
+		static constexpr std::uint64_t handle_tag_mask = 3;
+		// poll on the wakeup eventfd, carries no handle
+		static constexpr std::uint64_t wakeup_data = handle_tag_mask;
+		// cancellations carry the handle of the operation they cancel with this tag
+		static constexpr std::uint64_t cancel_tag = handle_tag_mask;
+
+		struct operation_canceller {
+			io_uring_event_loop* _loop;
+			std::uint64_t _user_data;
+
+			void operator()() const noexcept;
+		};
+
+		struct operation {
+			std::reference_wrapper<io_uring_event_loop> _loop;
+			io_uring_sqe _sqe;
+			std::optional<std::chrono::milliseconds> _timeout;
+			std::stop_token _token;
+			stop_registration<operation_canceller> _cancel;
+
+			void operator()(event_handle<int>& handle);
+		};
+
+		file _ring_fd;
+		std::reference_wrapper<executor> _exec;
+		std::mutex _mutex;
+		std::thread::id _poll_thread;
+
+		std::optional<mapping> _sq_ring;
+		std::optional<mapping> _cq_ring;
+		std::optional<mapping> _sqes_ring;
+
+		unsigned* _sq_head;
+		unsigned* _sq_tail;
+		unsigned* _sq_mask;
+		unsigned* _sq_array;
+		io_uring_sqe* _sqes;
+		// timeouts point into this, one slot per sqe so it stays valid until the kernel consumed the sqe
+		std::vector<__kernel_timespec> _timespecs;
+
+		unsigned* _cq_head;
+		unsigned* _cq_tail;
+		unsigned* _cq_mask;
+		io_uring_cqe* _cqes;
+
+		unsigned _pending = 0;
+		// user_data of operations that were asked to be cancelled, their -ECANCELED is not a timeout. Guarded by
+		// _mutex.
+		std::vector<std::uint64_t> _cancelled;
+
+	public:
+		using operation_type = event<int, operation>;
+
+		io_uring_event_loop(executor& exec, unsigned entries = 256);
+		io_uring_event_loop(const io_uring_event_loop& other) = delete;
+
+		task<std::size_t> recv(const file& fd, char* data, std::size_t size, std::stop_token token = {}) override;
+		task<std::size_t> send(const file& fd, const char* data, std::size_t size, std::stop_token token = {}) override;
+		task<file> accept(const file& fd) override;
+		task<bool> connect(const file& fd, const sockaddr* addr, socklen_t len) override;
+
+		void poll() override;
+
+	private:
+		void schedule_event(event_pair event, std::optional<std::chrono::milliseconds> timeout,
+							event_type::handle_type& handle) override;
+		void schedule_sleep(clock::time_point deadline, loop_timer& timer, event_type::handle_type& handle) override;
+		void cancel_event(event_pair event, event_type::handle_type& handle) noexcept override;
+
+		operation_type submit(const io_uring_sqe& sqe, std::optional<std::chrono::milliseconds> timeout = std::nullopt,
+							  std::stop_token token = {});
+		// asks the kernel to cancel the operation with user_data, it then completes with -ECANCELED
+		void cancel(std::uint64_t user_data) noexcept;
+		bool take_cancelled(std::uint64_t user_data);
+
+		// timespec is copied next to the sqe and passed in its addr, for operations that take one
+		void push(const io_uring_sqe& sqe, std::uint64_t user_data, std::optional<std::chrono::milliseconds> timeout,
+				  const __kernel_timespec* timespec = nullptr);
+		void publish_sqe();
+		unsigned enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+		void complete(const io_uring_cqe& cqe);
+		void arm_wakeup();
+
+		static std::size_t check_result(int res);
+	};
+} // namespace cobra
+
+#endif
@@ -4,21 +4,52 @@
 #include "cobra/asyncio/task.hh"
 #include "cobra/asyncio/executor.hh"
 
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+
 namespace cobra {
+	// Taking a free mutex is a single compare and swap. Coroutines that find it locked push themselves onto a lock
+	// free stack that the state word points to, and unlock moves them over to a FIFO that only the holder touches,
+	// so waiters get the mutex in the order they came in. The waiter queue is intrusive, its nodes are the lock
+	// events in the waiting coroutines' frames. With a spin count, lock retries that many times before it parks,
+	// which only pays off when the holder runs on another thread.
 	class async_mutex {
-		executor* _exec;
-		std::queue<event_handle<void>*> _queue;
-		std::mutex _mutex;
-		bool _locked = false;
+	public:
+		// how unlock passes the mutex on to the next waiter
+		enum class handoff {
+			// through the executor, the unlocking coroutine carries on first
+			schedule,
+			// resumes the waiter right away on the unlocking thread, the unlocking coroutine continues once the
+			// waiter suspends
+			direct,
+		};
 
+	private:
 		struct lock_event {
 			async_mutex* _mutex;
+			lock_event* _next = nullptr;
+			event_handle<void>* _handle = nullptr;
 
 			void operator()(event_handle<void>& handle);
 		};
 
+		// besides these, the state holds the lock_event that queued last, which links to the ones before it
+		static constexpr std::uintptr_t locked_no_waiters = 0;
+		static constexpr std::uintptr_t not_locked = 1;
+
+		executor* _exec;
+		handoff _handoff;
+		unsigned _spin;
+		std::atomic<std::uintptr_t> _state = not_locked;
+		// waiters in arrival order, only touched by whoever holds the mutex
+		lock_event* _waiters = nullptr;
+
 	public:
-		async_mutex(executor* exec = &global_executor);
+		async_mutex(executor* exec = &global_executor, handoff mode = handoff::schedule, unsigned spin = 0);
+		async_mutex(const async_mutex& other) = delete;
+		~async_mutex();
 
 		event<void, lock_event> lock();
 		bool try_lock();
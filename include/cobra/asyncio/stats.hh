@@ -0,0 +1,63 @@
+#ifndef COBRA_ASYNCIO_STATS_HH
+#define COBRA_ASYNCIO_STATS_HH
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace cobra {
+	// Counter that only its owning thread writes, while any thread may read it. A relaxed load and store instead of
+	// a read-modify-write keeps it as cheap as a plain integer.
+	class stat_counter {
+		std::atomic<std::uint64_t> _value = 0;
+
+	public:
+		inline void add(std::uint64_t n = 1) noexcept {
+			_value.store(_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+
+		inline std::uint64_t get() const noexcept {
+			return _value.load(std::memory_order_relaxed);
+		}
+	};
+
+	// plain copy of a stat_histogram, snapshots of several threads can be added up
+	struct histogram_snapshot {
+		static constexpr std::size_t bucket_count = 40;
+
+		std::array<std::uint64_t, bucket_count> buckets = {};
+		std::uint64_t count = 0;
+		std::uint64_t sum = 0;
+		std::uint64_t max = 0;
+
+		histogram_snapshot& operator+=(const histogram_snapshot& other) noexcept;
+
+		double mean() const noexcept;
+		// upper bound of the bucket the q-th quantile falls in, 0 when nothing was recorded
+		std::uint64_t quantile(double q) const noexcept;
+	};
+
+	// Histogram with power of two buckets, bucket i counts the values that need i bits, the last bucket also takes
+	// everything bigger. Single writer, like stat_counter.
+	class stat_histogram {
+		std::array<stat_counter, histogram_snapshot::bucket_count> _buckets;
+		stat_counter _count;
+		stat_counter _sum;
+		std::atomic<std::uint64_t> _max = 0;
+
+	public:
+		void record(std::uint64_t value) noexcept;
+
+		template <class Rep, class Period>
+		inline void record(std::chrono::duration<Rep, Period> duration) noexcept {
+			auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+			record(static_cast<std::uint64_t>(nanoseconds > 0 ? nanoseconds : 0));
+		}
+
+		histogram_snapshot snapshot() const noexcept;
+	};
+} // namespace cobra
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef COBRA_ASYNCIO_STOP_REGISTRATION_HH
+#define COBRA_ASYNCIO_STOP_REGISTRATION_HH
+
+#include <cassert>
+#include <optional>
+#include <stop_token>
+#include <utility>
+
+namespace cobra {
+
+	// std::stop_callback that can be a member of an awaitable. Awaitables get moved around before they are awaited,
+	// so a registration is only armed from await_suspend, once it sits in the coroutine frame for good. Destroying
+	// an armed registration waits for a callback that is running on another thread.
+	template <class Callback>
+	class stop_registration {
+		std::optional<std::stop_callback<Callback>> _callback;
+
+	public:
+		stop_registration() noexcept = default;
+
+		stop_registration(stop_registration&& other) noexcept {
+			assert(!other._callback && "an armed stop_registration can not be moved");
+		}
+
+		// runs callback right away if a stop was requested already
+		void arm(const std::stop_token& token, Callback callback) {
+			_callback.emplace(token, std::move(callback));
+		}
+	};
+} // namespace cobra
+
+#endif
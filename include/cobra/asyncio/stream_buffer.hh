@@ -39,6 +39,11 @@ namespace cobra {
 			_buffer_begin += size;
 		}
 
+		// what fill_buf hands out without reading from the stream
+		std::size_t available() const {
+			return _buffer_begin < _buffer_end ? _buffer_end - _buffer_begin : 0;
+		}
+
 		task<std::size_t> read(char_type* data, std::size_t size) {
 			if (_buffer_begin >= _buffer_end && size >= _buffer_size) {
 				co_return co_await _stream.read(data, size);
@@ -107,6 +112,7 @@ namespace cobra {
 		}
 
 		void consume(std::size_t size) {
+			base::_stream.consume(size);
 			base::_limit -= size;
 		}
 	};
@@ -2,29 +2,27 @@
 #define COBRA_ASYNCIO_TASK_HH
 
 #include "cobra/asyncio/coroutine.hh"
+#include "cobra/asyncio/frame_allocator.hh"
 #include "cobra/asyncio/promise.hh"
 
-#include <atomic>
+#include <coroutine>
 
 namespace cobra {
 	template <class T>
 	class task_promise;
 
+	// Lazily started coroutine. Awaiting a task transfers control straight to it and the task transfers control
+	// straight back once it finishes, so arbitrarily long chains of co_await run in constant stack space.
 	template <class T>
 	class [[nodiscard]] task : public coroutine<task_promise<T>> {
 	public:
 		bool await_ready() const noexcept {
-			coroutine<task_promise<T>>::handle().resume();
-			bool flag = coroutine<task_promise<T>>::handle().promise().flag().test();
-			return flag;
+			return false;
 		}
 
-		void await_suspend(std::coroutine_handle<> handle) const noexcept {
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) const noexcept {
 			coroutine<task_promise<T>>::handle().promise().set_next(handle);
-
-			if (coroutine<task_promise<T>>::handle().promise().flag().test_and_set()) {
-				coroutine<task_promise<T>>::handle().promise().next().resume();
-			}
+			return coroutine<task_promise<T>>::handle();
 		}
 
 		T await_resume() {
@@ -39,10 +37,12 @@ namespace cobra {
 		}
 
 		template <class T>
-		void await_suspend(std::coroutine_handle<task_promise<T>> handle) const noexcept {
-			if (handle.promise().flag().test_and_set()) {
-				handle.promise().next().resume();
-			}
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<task_promise<T>> handle) const noexcept {
+			std::coroutine_handle<> next = handle.promise().next();
+
+			if (next)
+				return next;
+			return std::noop_coroutine();
 		}
 
 		void await_resume() const noexcept {
@@ -51,9 +51,7 @@ namespace cobra {
 	};
 
 	template <class T>
-	class task_promise : public promise<T> {
-		std::atomic_flag _flag;
-
+	class task_promise : public promise<T>, public pooled_frame {
 	public:
 		task<T> get_return_object() noexcept {
 			return {*this};
@@ -66,10 +64,6 @@ namespace cobra {
 		auto final_suspend() const noexcept {
 			return task_final_suspend();
 		}
-
-		std::atomic_flag& flag() noexcept {
-			return _flag;
-		}
 	};
 } // namespace cobra
 
@@ -0,0 +1,421 @@
+#ifndef COBRA_ASYNCIO_TASK_GROUP_HH
+#define COBRA_ASYNCIO_TASK_GROUP_HH
+
+#include "cobra/asyncio/coroutine.hh"
+#include "cobra/asyncio/event.hh"
+#include "cobra/asyncio/frame_allocator.hh"
+#include "cobra/asyncio/promise.hh"
+#include "cobra/asyncio/task.hh"
+
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <stop_token>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace cobra {
+	// what when_all and when_any hand out for an awaitable, void results become std::monostate
+	template <class T>
+	using when_value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+	namespace detail {
+		template <class Awaitable>
+		using await_result_t = decltype(std::declval<Awaitable&>().await_resume());
+
+		// Counts the children of a join plus the joining coroutine itself. Whoever arrives last resumes the joining
+		// coroutine, so it does not matter on which thread or in which order the children finish.
+		class join_counter {
+			std::atomic<std::size_t> _count = 1;
+			std::coroutine_handle<> _waiter;
+
+		public:
+			inline void add() noexcept {
+				_count.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			inline std::coroutine_handle<> arrive() noexcept {
+				if (_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					return _waiter;
+				return std::noop_coroutine();
+			}
+
+			// true if the waiter has to suspend because some children are still running
+			inline bool wait(std::coroutine_handle<> waiter) noexcept {
+				_waiter = waiter;
+				return _count.fetch_sub(1, std::memory_order_acq_rel) > 1;
+			}
+
+			// makes the counter usable for another join
+			inline void reset() noexcept {
+				_count.store(1, std::memory_order_relaxed);
+			}
+
+			inline bool idle() const noexcept {
+				return _count.load(std::memory_order_acquire) == 1;
+			}
+		};
+
+		// arrives at its counter when the body finished, the frame stays around for the result
+		class join_final_suspend {
+		public:
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			template <class Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) const noexcept {
+				return handle.promise().counter().arrive();
+			}
+
+			void await_resume() const noexcept {
+				return;
+			}
+		};
+
+		template <class T>
+		class join_task_promise;
+
+		template <class T>
+		class join_task : public coroutine<join_task_promise<T>> {
+		public:
+			void start(join_counter& counter) {
+				coroutine<join_task_promise<T>>::handle().promise().set_counter(counter);
+				counter.add();
+				coroutine<join_task_promise<T>>::handle().resume();
+			}
+
+			when_value<T> value() {
+				if constexpr (std::is_void_v<T>) {
+					coroutine<join_task_promise<T>>::handle().promise().result().get_value_move();
+					return {};
+				} else {
+					return coroutine<join_task_promise<T>>::handle().promise().result().get_value_move();
+				}
+			}
+		};
+
+		template <class T>
+		class join_task_promise : public promise<T>, public pooled_frame {
+			join_counter* _counter = nullptr;
+
+		public:
+			join_task<T> get_return_object() noexcept {
+				return {*this};
+			}
+
+			auto initial_suspend() const noexcept {
+				return std::suspend_always();
+			}
+
+			auto final_suspend() const noexcept {
+				return join_final_suspend();
+			}
+
+			void set_counter(join_counter& counter) noexcept {
+				_counter = &counter;
+			}
+
+			join_counter& counter() const noexcept {
+				return *_counter;
+			}
+		};
+
+		// Remembers which child of a join failed first in time and stops the others. The siblings it stops usually
+		// fail with a cancelled_exception, which says nothing about why the join went wrong.
+		class join_failure {
+			std::atomic_flag _failed;
+			std::exception_ptr _exception;
+			std::stop_source _source;
+
+		public:
+			explicit join_failure(std::stop_source source) : _source(std::move(source)) {}
+
+			void fail(std::exception_ptr exception) noexcept {
+				if (!_failed.test_and_set(std::memory_order_acq_rel)) {
+					_exception = exception;
+					_source.request_stop();
+				}
+			}
+
+			// only meaningful once every child arrived at the counter
+			inline std::exception_ptr exception() const noexcept {
+				return _exception;
+			}
+		};
+
+		// a child that fails stops its siblings through failure
+		template <class Awaitable>
+		join_task<await_result_t<Awaitable>> make_join_task(Awaitable awaitable, join_failure& failure) {
+			try {
+				co_return co_await awaitable;
+			} catch (...) {
+				failure.fail(std::current_exception());
+				throw;
+			}
+		}
+
+		// runs start, which starts the children, and then waits for them
+		template <class Start>
+		class join_awaiter {
+			join_counter& _counter;
+			Start _start;
+
+		public:
+			join_awaiter(join_counter& counter, Start start) : _counter(counter), _start(std::move(start)) {}
+
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) {
+				_start();
+				return _counter.wait(handle);
+			}
+
+			void await_resume() noexcept {
+				_counter.reset();
+			}
+		};
+
+		// The frame frees itself once the body finished, the body must not throw. A task started with a counter
+		// arrives at it after the frame is gone.
+		class detached_task {
+		public:
+			class promise_type;
+
+			class final_suspend_type {
+			public:
+				bool await_ready() const noexcept {
+					return false;
+				}
+
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) const noexcept {
+					join_counter* counter = handle.promise()._counter;
+
+					handle.destroy();
+					if (counter)
+						return counter->arrive();
+					return std::noop_coroutine();
+				}
+
+				void await_resume() const noexcept {
+					return;
+				}
+			};
+
+			class promise_type : public pooled_frame {
+				friend class final_suspend_type;
+				friend class detached_task;
+
+				join_counter* _counter = nullptr;
+
+			public:
+				detached_task get_return_object() noexcept {
+					return {std::coroutine_handle<promise_type>::from_promise(*this)};
+				}
+
+				auto initial_suspend() const noexcept {
+					return std::suspend_always();
+				}
+
+				auto final_suspend() const noexcept {
+					return final_suspend_type();
+				}
+
+				void return_void() const noexcept {
+					return;
+				}
+
+				void unhandled_exception() const noexcept {
+					std::terminate();
+				}
+			};
+
+			std::coroutine_handle<promise_type> _handle;
+
+			void start() const {
+				_handle.resume();
+			}
+
+			void start(join_counter& counter) const {
+				_handle.promise()._counter = &counter;
+				counter.add();
+				_handle.resume();
+			}
+		};
+
+		template <class Result>
+		struct when_any_state {
+			std::atomic_flag won;
+			event_handle<Result> handle;
+			std::stop_source source;
+
+			when_any_state(std::stop_source source) : source(std::move(source)) {}
+		};
+
+		template <std::size_t Index, class Result, class Awaitable>
+		detached_task when_any_child(std::shared_ptr<when_any_state<Result>> state, Awaitable awaitable) {
+			try {
+				if constexpr (std::is_void_v<await_result_t<Awaitable>>) {
+					co_await awaitable;
+
+					if (!state->won.test_and_set(std::memory_order_acq_rel)) {
+						state->source.request_stop();
+						state->handle.set_value(Result(std::in_place_index<Index>));
+					}
+				} else {
+					auto value = co_await awaitable;
+
+					if (!state->won.test_and_set(std::memory_order_acq_rel)) {
+						state->source.request_stop();
+						state->handle.set_value(Result(std::in_place_index<Index>, std::move(value)));
+					}
+				}
+			} catch (...) {
+				if (!state->won.test_and_set(std::memory_order_acq_rel)) {
+					state->source.request_stop();
+					state->handle.set_exception(std::current_exception());
+				}
+			}
+		}
+
+		template <class Result, class Start>
+		class when_any_awaiter {
+			event_handle<Result>& _handle;
+			Start _start;
+
+		public:
+			when_any_awaiter(event_handle<Result>& handle, Start start) : _handle(handle), _start(std::move(start)) {}
+
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			// a child that finishes while the others are still being started leaves the result for suspend to find
+			bool await_suspend(std::coroutine_handle<> handle) {
+				_handle.set_next(handle);
+				_start();
+				return !_handle.suspend();
+			}
+
+			Result await_resume() {
+				return _handle.value();
+			}
+		};
+	} // namespace detail
+
+	// Runs all awaitables concurrently on the awaiting thread, each one until it first suspends, and finishes once
+	// every one of them finished. If any of them threw, the exception of the one that failed first is rethrown, but
+	// only after all of them are done, so nothing they refer to goes away while they still run. That first failure
+	// requests a stop on source, children that wait with its token are cancelled that way and whatever they throw
+	// because of it is dropped.
+	template <class... Awaitables>
+	auto when_all(std::stop_source source, Awaitables... awaitables)
+		-> task<std::tuple<when_value<detail::await_result_t<Awaitables>>...>> {
+		using result_type = std::tuple<when_value<detail::await_result_t<Awaitables>>...>;
+
+		detail::join_counter counter;
+		detail::join_failure failure(std::move(source));
+		std::tuple children(detail::make_join_task(std::move(awaitables), failure)...);
+
+		co_await detail::join_awaiter(counter, [&counter, &children] {
+			std::apply([&counter](auto&... child) { (child.start(counter), ...); }, children);
+		});
+		if (std::exception_ptr exception = failure.exception())
+			std::rethrow_exception(exception);
+		co_return std::apply([](auto&... child) { return result_type{child.value()...}; }, children);
+	}
+
+	template <class... Awaitables>
+	auto when_all(Awaitables... awaitables) -> task<std::tuple<when_value<detail::await_result_t<Awaitables>>...>> {
+		return when_all(std::stop_source(std::nostopstate), std::move(awaitables)...);
+	}
+
+	// Runs all awaitables concurrently and finishes with the result of the first one that finishes, the index of the
+	// variant tells which one it was. The winner requests a stop on source. The others keep running detached until
+	// they notice the stop or finish on their own and their results are dropped, so they must not refer to anything
+	// that the awaiting coroutine owns.
+	template <class... Awaitables>
+	auto when_any(std::stop_source source, Awaitables... awaitables)
+		-> task<std::variant<when_value<detail::await_result_t<Awaitables>>...>> {
+		static_assert(sizeof...(Awaitables) > 0, "when_any needs something to wait for");
+		using result_type = std::variant<when_value<detail::await_result_t<Awaitables>>...>;
+
+		auto state = std::make_shared<detail::when_any_state<result_type>>(std::move(source));
+		auto start = [&]<std::size_t... Index>(std::index_sequence<Index...>) {
+			(detail::when_any_child<Index, result_type>(state, std::move(awaitables)).start(), ...);
+		};
+
+		co_return co_await detail::when_any_awaiter(state->handle, [&start] {
+			start(std::index_sequence_for<Awaitables...>());
+		});
+	}
+
+	template <class... Awaitables>
+	auto when_any(Awaitables... awaitables) -> task<std::variant<when_value<detail::await_result_t<Awaitables>>...>> {
+		return when_any(std::stop_source(std::nostopstate), std::move(awaitables)...);
+	}
+
+	// Nursery for coroutines that run alongside the one owning the group. spawn starts a child right away, on the
+	// calling thread, and join waits until every child spawned so far finished and then rethrows the first exception
+	// a child ended with. The first failure also requests a stop on the group's source, so children that wait with
+	// token() are cancelled together. Children refer to the group, so it has to be joined before it is destroyed.
+	class task_group {
+		detail::join_counter _counter;
+		std::atomic_flag _failed;
+		std::exception_ptr _exception;
+		std::stop_source _source;
+
+		template <class Awaitable>
+		static detail::detached_task run(task_group& group, Awaitable awaitable) {
+			try {
+				co_await awaitable;
+			} catch (...) {
+				group.fail(std::current_exception());
+			}
+		}
+
+		void fail(std::exception_ptr exception) noexcept {
+			if (!_failed.test_and_set(std::memory_order_acq_rel)) {
+				_exception = exception;
+				_source.request_stop();
+			}
+		}
+
+	public:
+		task_group() = default;
+		explicit task_group(std::stop_source source) : _source(std::move(source)) {}
+		task_group(const task_group& other) = delete;
+
+		~task_group() {
+			assert(_counter.idle() && "task_group destroyed while children were still running");
+		}
+
+		inline std::stop_token token() const noexcept {
+			return _source.get_token();
+		}
+
+		template <class Awaitable>
+		void spawn(Awaitable awaitable) {
+			run(*this, std::move(awaitable)).start(_counter);
+		}
+
+		task<void> join() {
+			co_await detail::join_awaiter(_counter, [] {});
+
+			// the source stays stopped, children spawned after a failure start out cancelled
+			if (_exception) {
+				_failed.clear(std::memory_order_relaxed);
+				std::rethrow_exception(std::exchange(_exception, nullptr));
+			}
+		}
+	};
+} // namespace cobra
+
+#endif
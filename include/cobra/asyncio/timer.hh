@@ -0,0 +1,107 @@
+#ifndef COBRA_ASYNCIO_TIMER_HH
+#define COBRA_ASYNCIO_TIMER_HH
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace cobra {
+
+	// intrusive entry of a timer_wheel. Links are never copied, a copy always starts out disarmed so that the owner
+	// can be moved around as long as it is not armed.
+	class timer_node {
+		friend class timer_wheel;
+
+		timer_node* _prev = nullptr;
+		timer_node* _next = nullptr;
+		std::uint64_t _deadline = 0;
+		unsigned _level = 0;
+		unsigned _slot = 0;
+		bool _armed = false;
+
+	public:
+		timer_node() noexcept = default;
+		timer_node(const timer_node& other) noexcept;
+		timer_node& operator=(const timer_node& other) noexcept;
+
+		inline bool armed() const noexcept {
+			return _armed;
+		}
+	};
+
+	// Hierarchical timing wheel with a resolution of one millisecond. Every level has 64 slots, each spanning 64
+	// times the slots of the level below it, which covers a little over two years with six levels. Timers are
+	// placed on the lowest level that can tell them apart from the current time and move down a level each time
+	// their slot comes up. Inserting and cancelling are O(1), finding the next deadline is a bit scan per level.
+	class timer_wheel {
+	public:
+		using clock = std::chrono::steady_clock;
+		using time_point = clock::time_point;
+
+	private:
+		static constexpr unsigned slot_bits = 6;
+		static constexpr unsigned slot_count = 1 << slot_bits;
+		static constexpr unsigned level_count = 6;
+		// used as _level of timers that already expired but were not popped yet
+		static constexpr unsigned expired_level = level_count;
+
+		struct list {
+			timer_node* head = nullptr;
+			timer_node* tail = nullptr;
+
+			void push_back(timer_node& node) noexcept;
+			void erase(timer_node& node) noexcept;
+
+			inline bool empty() const noexcept {
+				return head == nullptr;
+			}
+		};
+
+		struct level {
+			std::uint64_t occupied = 0;
+			std::array<list, slot_count> slots;
+		};
+
+		struct expiration {
+			unsigned level;
+			unsigned slot;
+			std::uint64_t deadline;
+		};
+
+		time_point _start;
+		std::uint64_t _elapsed = 0;
+		std::array<level, level_count> _levels;
+		list _expired;
+		std::size_t _size = 0;
+
+	public:
+		timer_wheel(time_point start = clock::now());
+		timer_wheel(const timer_wheel& other) = delete;
+
+		// arms node, a deadline in the past expires on the next pop_expired
+		void insert(timer_node& node, time_point deadline) noexcept;
+		void cancel(timer_node& node) noexcept;
+
+		// disarms and returns a timer that expired at or before now, nullptr once there are none left
+		timer_node* pop_expired(time_point now) noexcept;
+		// the earliest point at which pop_expired could return a timer
+		std::optional<time_point> next_deadline() const noexcept;
+
+		inline std::size_t size() const noexcept {
+			return _size;
+		}
+
+		inline bool empty() const noexcept {
+			return _size == 0;
+		}
+
+	private:
+		std::uint64_t to_tick(time_point point, bool round_up) const noexcept;
+		void link(timer_node& node) noexcept;
+		std::optional<expiration> next_expiration() const noexcept;
+	};
+} // namespace cobra
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef COBRA_ASYNCIO_WORK_STEALING_DEQUE_HH
+#define COBRA_ASYNCIO_WORK_STEALING_DEQUE_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cobra {
+
+	// Chase-Lev deque (Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models"). The owning thread
+	// pushes and pops at the bottom, any other thread may steal from the top. Elements are small trivially copyable
+	// values (pointers or tagged words) so that every slot can be a lock free atomic, T{} means "nothing".
+	template <class T>
+	class work_stealing_deque {
+		static_assert(std::atomic<T>::is_always_lock_free);
+
+		struct buffer {
+			std::size_t mask;
+			std::unique_ptr<std::atomic<T>[]> slots;
+
+			buffer(std::size_t capacity) : mask(capacity - 1), slots(new std::atomic<T>[capacity]) {}
+
+			inline std::size_t capacity() const {
+				return mask + 1;
+			}
+
+			inline T get(std::int64_t index) const {
+				return slots[index & mask].load(std::memory_order_relaxed);
+			}
+
+			inline void put(std::int64_t index, T value) {
+				slots[index & mask].store(value, std::memory_order_relaxed);
+			}
+		};
+
+		alignas(64) std::atomic<std::int64_t> _top = 0;
+		alignas(64) std::atomic<std::int64_t> _bottom = 0;
+		std::atomic<buffer*> _buffer;
+		// thieves may still be reading from a buffer that was grown out of, so they live as long as the deque
+		std::vector<std::unique_ptr<buffer>> _buffers;
+
+	public:
+		work_stealing_deque(std::size_t capacity = 256) {
+			_buffers.push_back(std::make_unique<buffer>(capacity));
+			_buffer.store(_buffers.back().get(), std::memory_order_relaxed);
+		}
+
+		work_stealing_deque(const work_stealing_deque& other) = delete;
+
+		// owner only
+		void push(T value) {
+			std::int64_t bottom = _bottom.load(std::memory_order_relaxed);
+			std::int64_t top = _top.load(std::memory_order_acquire);
+			buffer* buf = _buffer.load(std::memory_order_relaxed);
+
+			if (bottom - top > static_cast<std::int64_t>(buf->capacity()) - 1)
+				buf = grow(buf, bottom, top);
+
+			buf->put(bottom, value);
+			_bottom.store(bottom + 1, std::memory_order_release);
+		}
+
+		// owner only, returns T{} when empty
+		T pop() {
+			std::int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+			buffer* buf = _buffer.load(std::memory_order_relaxed);
+			_bottom.store(bottom, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::int64_t top = _top.load(std::memory_order_relaxed);
+
+			if (top > bottom) {
+				_bottom.store(bottom + 1, std::memory_order_relaxed);
+				return T{};
+			}
+
+			T value = buf->get(bottom);
+
+			if (top == bottom) {
+				// last element, race the thieves for it
+				if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					value = T{};
+				_bottom.store(bottom + 1, std::memory_order_relaxed);
+			}
+			return value;
+		}
+
+		// any thread, returns T{} when empty or when it lost a race
+		T steal() {
+			std::int64_t top = _top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::int64_t bottom = _bottom.load(std::memory_order_acquire);
+
+			if (top >= bottom)
+				return T{};
+
+			T value = _buffer.load(std::memory_order_acquire)->get(top);
+
+			if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return T{};
+			return value;
+		}
+
+		// racy, only meant as a hint
+		inline bool empty() const {
+			return _bottom.load(std::memory_order_relaxed) <= _top.load(std::memory_order_relaxed);
+		}
+
+		// racy, only meant as a hint
+		inline std::size_t size() const {
+			std::int64_t size = _bottom.load(std::memory_order_relaxed) - _top.load(std::memory_order_relaxed);
+			return size > 0 ? static_cast<std::size_t>(size) : 0;
+		}
+
+	private:
+		buffer* grow(buffer* old, std::int64_t bottom, std::int64_t top) {
+			auto buf = std::make_unique<buffer>(old->capacity() * 2);
+
+			for (std::int64_t i = top; i < bottom; ++i)
+				buf->put(i, old->get(i));
+
+			_buffers.push_back(std::move(buf));
+			_buffer.store(_buffers.back().get(), std::memory_order_release);
+			return _buffers.back().get();
+		}
+	};
+} // namespace cobra
+
+#endif
@@ -50,8 +50,16 @@ extern "C" {
 	X(listen)                                                                                                          \
 	X(ssl)                                                                                                             \
 	X(server_name)                                                                                                     \
+	X(keepalive_timeout)                                                                                               \
+	X(keepalive_requests)                                                                                              \
 	COBRA_BLOCK_KEYWORDS
 
+#define COBRA_GLOBAL_KEYWORDS                                                                                          \
+	X(server)                                                                                                          \
+	X(threads)                                                                                                         \
+	X(cpus)                                                                                                            \
+	X(max_events)
+
 namespace cobra {
 	namespace fs = std::filesystem;
 	using port = unsigned short;
@@ -670,12 +678,17 @@ namespace cobra {
 		class server_config : protected block_config {
 			std::set<define<listen_address>> _addresses;
 			std::optional<define<ssl_config>> _ssl;
+			std::optional<define<std::size_t>> _keepalive_timeout;
+			std::optional<define<std::size_t>> _keepalive_requests;
 
 			server_config() = default;
 
 			friend class server;
 
 		public:
+			// a day, in seconds. The server keeps the timeout in milliseconds and adds it to the clock.
+			static constexpr std::size_t max_keepalive_timeout = 24 * 60 * 60;
+
 			static define<server_config> parse(parse_session& session);
 			static std::vector<server_config> parse_servers(parse_session& session);
 
@@ -715,6 +728,57 @@ namespace cobra {
 			//TODO add lint for non rooted handlers (static, cgi, fast_cgi)
 			void parse_listen(parse_session& session);
 			void parse_ssl(parse_session& session);
+			void parse_keepalive_timeout(parse_session& session);
+			void parse_keepalive_requests(parse_session& session);
+		};
+
+		class global_config {
+			std::vector<server_config> _servers;
+			std::optional<define<std::size_t>> _threads;
+			std::optional<define<std::vector<unsigned>>> _cpus;
+			std::optional<define<std::size_t>> _max_events;
+
+			global_config() = default;
+
+		public:
+			static constexpr std::size_t max_threads = 1024;
+			// epoll_wait takes the batch size as an int
+			static constexpr std::size_t max_max_events = std::numeric_limits<int>::max();
+
+			static global_config parse(parse_session& session);
+
+			inline const std::vector<server_config>& servers() const {
+				return _servers;
+			}
+
+			inline std::vector<server_config>& servers() {
+				return _servers;
+			}
+
+			inline std::optional<std::size_t> threads() const {
+				if (_threads)
+					return _threads->def;
+				return std::nullopt;
+			}
+
+			// reactor i is pinned to cpus()[i % cpus().size()]
+			inline std::optional<std::vector<unsigned>> cpus() const {
+				if (_cpus)
+					return _cpus->def;
+				return std::nullopt;
+			}
+
+			// the most events a reactor's epoll loop takes from a single wait
+			inline std::optional<std::size_t> max_events() const {
+				if (_max_events)
+					return _max_events->def;
+				return std::nullopt;
+			}
+
+		private:
+			void parse_threads(parse_session& session);
+			void parse_cpus(parse_session& session);
+			void parse_max_events(parse_session& session);
 		};
 
 		class config {
@@ -747,6 +811,9 @@ namespace cobra {
 		public:
 			std::vector<listen_address> addresses;
 			std::optional<ssl_config> ssl;
+			// seconds an idle connection waits for its next request, 0 turns keep-alive off
+			std::optional<std::size_t> keepalive_timeout;
+			std::optional<std::size_t> keepalive_requests;
 
 			server(const server_config& cfg);
 
@@ -20,6 +20,12 @@ namespace cobra {
 		timeout_exception();
 	};
 
+	// thrown by waits that were given a std::stop_token once a stop was requested
+	class cancelled_exception : public std::runtime_error {
+	public:
+		cancelled_exception();
+	};
+
 	class parse_error : public std::runtime_error {
 	public:
 		parse_error(const std::string& what);
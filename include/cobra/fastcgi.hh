@@ -1,11 +1,14 @@
 #ifndef COBRA_FASTCGI_HH
 #define COBRA_FASTCGI_HH
 
+#include "cobra/asyncio/channel.hh"
 #include "cobra/asyncio/stream.hh"
 #include "cobra/asyncio/mutex.hh"
 #include "cobra/net/stream.hh"
 
 #include <cstdint>
+#include <stop_token>
+#include <vector>
 
 #define FCGI_VERSION_1 1
 #define FCGI_KEEP_CONN 1
@@ -28,19 +31,26 @@ namespace cobra {
 		fcgi_unknown_type = 11,
 	};
 
+	// Hands the contents of the records that fastcgi_client_connection::poll receives to the reader, a record at a
+	// time. Once max_records are waiting, poll waits for the reader to catch up.
 	template <fastcgi_record_type Type>
 	class fastcgi_istream : public istream_impl<fastcgi_istream<Type>> {
 	public:
 		using typename istream_impl<fastcgi_istream<Type>>::char_type;
 
+		static constexpr std::size_t max_records = 16;
+
 	private:
-		std::deque<char_type> _data;
-		bool _closed = false;
+		async_channel<std::vector<char_type>> _records;
+		std::vector<char_type> _record;
+		std::size_t _offset = 0;
 
 	public:
+		fastcgi_istream() : _records(max_records) {}
+
 		task<std::size_t> read(char_type* data, std::size_t size);
-		task<void> write(const char_type* data, std::size_t size);
-		task<void> close();
+		task<void> write(std::vector<char_type> record);
+		void close();
 	};
 
 	template <fastcgi_record_type Type>
@@ -56,8 +66,9 @@ namespace cobra {
 	class fastcgi_client;
 
 	class fastcgi_client_connection {
+		// held around every record, handed straight to the next writer instead of going through an executor
 		async_mutex _mutex;
-		async_condition_variable _condition_variable;
+		std::stop_token _token;
 		istream_reference _istream;
 		ostream_reference _ostream;
 		// TODO: only remove client from list after caller is done with it
@@ -67,10 +78,11 @@ namespace cobra {
 		task<void> write_header(fastcgi_record_type type, std::uint16_t request_id, std::uint16_t content_length);
 
 	public:
-		fastcgi_client_connection(istream_reference istream, ostream_reference ostream);
+		// waiting for the records of a client, on either side, throws cancelled_exception once token is stopped
+		fastcgi_client_connection(istream_reference istream, ostream_reference ostream, std::stop_token token = {});
 
 		async_mutex& mutex();
-		async_condition_variable& condition_variable();
+		const std::stop_token& stop_token() const;
 
 		task<std::size_t> write(std::uint16_t request_id, fastcgi_record_type type, const char* data, std::size_t size);
 		task<void> flush(std::uint16_t request_id, fastcgi_record_type type);
@@ -100,38 +112,36 @@ namespace cobra {
 	template <fastcgi_record_type Type>
 	task<std::size_t> fastcgi_istream<Type>::read(typename fastcgi_istream<Type>::char_type* data, std::size_t size) {
 		fastcgi_client* client = static_cast<fastcgi_client*>(this);
-		async_lock lock = co_await async_lock::lock(client->connection()->mutex());
 
-		while (_data.empty()) {
-			if (_closed) {
+		while (_offset == _record.size()) {
+			std::optional<std::vector<char_type>> record = co_await _records.recv(client->connection()->stop_token());
+
+			if (!record)
 				co_return 0;
-			}
 
-			co_await client->connection()->condition_variable().wait(lock);
+			_record = std::move(*record);
+			_offset = 0;
 		}
 
-		size = std::min(_data.size(), size);
-		auto end = _data.begin();
-		std::advance(end, size);
-		std::copy(_data.begin(), end, data);
-		_data.erase(_data.begin(), end);
+		size = std::min(_record.size() - _offset, size);
+		std::copy_n(_record.data() + _offset, size, data);
+		_offset += size;
 		co_return size;
 	}
 
 	template <fastcgi_record_type Type>
-	task<void> fastcgi_istream<Type>::write(const typename fastcgi_istream<Type>::char_type* data, std::size_t size) {
+	task<void> fastcgi_istream<Type>::write(std::vector<typename fastcgi_istream<Type>::char_type> record) {
 		fastcgi_client* client = static_cast<fastcgi_client*>(this);
-		async_lock lock = co_await async_lock::lock(client->connection()->mutex());
-		_data.insert(_data.end(), data, data + size);
-		client->connection()->condition_variable().notify_all();
+
+		// an empty stdout/stderr record marks the end of the stream, close() takes care of that. A record sent after
+		// close() is dropped by the channel.
+		if (!record.empty())
+			co_await _records.send(std::move(record), client->connection()->stop_token());
 	}
 
 	template <fastcgi_record_type Type>
-	task<void> fastcgi_istream<Type>::close() {
-		fastcgi_client* client = static_cast<fastcgi_client*>(this);
-		async_lock lock = co_await async_lock::lock(client->connection()->mutex());
-		_closed = true;
-		client->connection()->condition_variable().notify_all();
+	void fastcgi_istream<Type>::close() {
+		_records.close();
 	}
 
 	template <fastcgi_record_type Type>
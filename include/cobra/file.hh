@@ -1,13 +1,26 @@
 #ifndef COBRA_FILE_HH
 #define COBRA_FILE_HH
 
+#include <cstddef>
+#include <optional>
+
 extern "C" {
 #include "unistd.h"
 }
 
 namespace cobra {
+	// notified right before the fd of a file is closed, so that state keyed on the fd number can be dropped before
+	// the number gets reused
+	class file_observer {
+	public:
+		virtual ~file_observer();
+		virtual void file_closed(int fd) noexcept = 0;
+	};
+
 	class file {
 		int _fd;
+		// mutable as observing a file does not change the file itself, event loops only ever see const files
+		mutable file_observer* _observer = nullptr;
 
 	public:
 		file() = delete;
@@ -23,10 +36,18 @@ namespace cobra {
 			return _fd;
 		}
 
+		inline file_observer* observer() const {
+			return _observer;
+		}
+
+		void set_observer(file_observer* observer) const noexcept;
+
 		void close();
 	};
 	
 	ssize_t check_return(ssize_t ret);
+	// like check_return, but returns std::nullopt instead of throwing when a nonblocking operation would block
+	std::optional<std::size_t> check_would_block(ssize_t ret);
 } // namespace cobra
 
 #endif
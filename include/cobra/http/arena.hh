@@ -0,0 +1,36 @@
+#ifndef COBRA_HTTP_ARENA_HH
+#define COBRA_HTTP_ARENA_HH
+
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+
+namespace cobra {
+	// Memory for everything a parsed request owns: its header fields, the list holding them and the parser's scratch
+	// space. Allocations bump a pointer through an inline block first and through blocks from the heap after that.
+	// Nothing is freed until release, which drops it all in one go and starts over at the inline block, so a
+	// connection that keeps one arena parses a typical browser request without touching the heap.
+	class request_arena {
+	public:
+		static constexpr std::size_t inline_size = 4096;
+
+	private:
+		alignas(std::max_align_t) std::array<std::byte, inline_size> _block;
+		std::pmr::monotonic_buffer_resource _resource;
+
+	public:
+		request_arena() : _resource(_block.data(), _block.size()) {}
+		request_arena(const request_arena& other) = delete;
+
+		inline std::pmr::memory_resource* resource() noexcept {
+			return &_resource;
+		}
+
+		// nothing allocated from the arena may be used afterwards
+		inline void release() noexcept {
+			_resource.release();
+		}
+	};
+} // namespace cobra
+
+#endif
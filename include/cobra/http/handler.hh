@@ -5,6 +5,8 @@
 #include "cobra/asyncio/stream.hh"
 #include "cobra/http/writer.hh"
 
+#include <stop_token>
+
 namespace cobra {
 	class static_config {
 	};
@@ -96,11 +98,12 @@ namespace cobra {
 		std::reference_wrapper<const T> _config;
 		std::reference_wrapper<const http_request> _request;
 		buffered_istream_reference _istream;
+		std::stop_token _hangup;
 
 	public:
 		handle_context(event_loop* loop, executor* exec, std::string root, std::string file, std::vector<std::string> index, const T& config, const http_request& request,
-					   buffered_istream_reference istream)
-			: _loop(loop), _exec(exec), _root(std::move(root)), _file(std::move(file)), _index(std::move(index)), _config(config), _request(request), _istream(istream) {}
+					   buffered_istream_reference istream, std::stop_token hangup = {})
+			: _loop(loop), _exec(exec), _root(std::move(root)), _file(std::move(file)), _index(std::move(index)), _config(config), _request(request), _istream(istream), _hangup(std::move(hangup)) {}
 
 		event_loop* loop() const {
 			return _loop;
@@ -134,6 +137,11 @@ namespace cobra {
 			return _istream;
 		}
 
+		// stopped once the client hung up, handlers stop whatever they keep busy for it through this
+		const std::stop_token& hangup_token() const {
+			return _hangup;
+		}
+
 		std::vector<std::string> try_files() const {
 			std::vector<std::string> files;
 
@@ -0,0 +1,168 @@
+#ifndef COBRA_HTTP_HEADER_HH
+#define COBRA_HTTP_HEADER_HH
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// X(enumerator, name) for every header field the server knows by name, the registered ones it is likely to meet
+// plus Status, which cgi scripts use
+#define COBRA_HTTP_HEADERS(X) \
+	X(accept, "Accept") \
+	X(accept_charset, "Accept-Charset") \
+	X(accept_encoding, "Accept-Encoding") \
+	X(accept_language, "Accept-Language") \
+	X(accept_ranges, "Accept-Ranges") \
+	X(access_control_allow_credentials, "Access-Control-Allow-Credentials") \
+	X(access_control_allow_headers, "Access-Control-Allow-Headers") \
+	X(access_control_allow_methods, "Access-Control-Allow-Methods") \
+	X(access_control_allow_origin, "Access-Control-Allow-Origin") \
+	X(access_control_expose_headers, "Access-Control-Expose-Headers") \
+	X(access_control_max_age, "Access-Control-Max-Age") \
+	X(access_control_request_headers, "Access-Control-Request-Headers") \
+	X(access_control_request_method, "Access-Control-Request-Method") \
+	X(age, "Age") \
+	X(allow, "Allow") \
+	X(alt_svc, "Alt-Svc") \
+	X(authorization, "Authorization") \
+	X(cache_control, "Cache-Control") \
+	X(connection, "Connection") \
+	X(content_disposition, "Content-Disposition") \
+	X(content_encoding, "Content-Encoding") \
+	X(content_language, "Content-Language") \
+	X(content_length, "Content-Length") \
+	X(content_location, "Content-Location") \
+	X(content_range, "Content-Range") \
+	X(content_security_policy, "Content-Security-Policy") \
+	X(content_type, "Content-Type") \
+	X(cookie, "Cookie") \
+	X(date, "Date") \
+	X(etag, "ETag") \
+	X(expect, "Expect") \
+	X(expires, "Expires") \
+	X(forwarded, "Forwarded") \
+	X(from, "From") \
+	X(host, "Host") \
+	X(if_match, "If-Match") \
+	X(if_modified_since, "If-Modified-Since") \
+	X(if_none_match, "If-None-Match") \
+	X(if_range, "If-Range") \
+	X(if_unmodified_since, "If-Unmodified-Since") \
+	X(keep_alive, "Keep-Alive") \
+	X(last_modified, "Last-Modified") \
+	X(link, "Link") \
+	X(location, "Location") \
+	X(max_forwards, "Max-Forwards") \
+	X(origin, "Origin") \
+	X(pragma, "Pragma") \
+	X(proxy_authenticate, "Proxy-Authenticate") \
+	X(proxy_authorization, "Proxy-Authorization") \
+	X(range, "Range") \
+	X(referer, "Referer") \
+	X(retry_after, "Retry-After") \
+	X(sec_fetch_dest, "Sec-Fetch-Dest") \
+	X(sec_fetch_mode, "Sec-Fetch-Mode") \
+	X(sec_fetch_site, "Sec-Fetch-Site") \
+	X(sec_fetch_user, "Sec-Fetch-User") \
+	X(server, "Server") \
+	X(set_cookie, "Set-Cookie") \
+	X(status, "Status") \
+	X(strict_transport_security, "Strict-Transport-Security") \
+	X(te, "TE") \
+	X(trailer, "Trailer") \
+	X(transfer_encoding, "Transfer-Encoding") \
+	X(upgrade, "Upgrade") \
+	X(upgrade_insecure_requests, "Upgrade-Insecure-Requests") \
+	X(user_agent, "User-Agent") \
+	X(vary, "Vary") \
+	X(via, "Via") \
+	X(www_authenticate, "WWW-Authenticate") \
+	X(x_content_type_options, "X-Content-Type-Options") \
+	X(x_forwarded_for, "X-Forwarded-For") \
+	X(x_forwarded_host, "X-Forwarded-Host") \
+	X(x_forwarded_proto, "X-Forwarded-Proto") \
+	X(x_frame_options, "X-Frame-Options") \
+
+namespace cobra {
+	enum class http_header : std::uint8_t {
+#define COBRA_HTTP_HEADER_ENUMERATOR(enumerator, name) enumerator,
+		COBRA_HTTP_HEADERS(COBRA_HTTP_HEADER_ENUMERATOR)
+#undef COBRA_HTTP_HEADER_ENUMERATOR
+	};
+
+	namespace detail {
+		inline constexpr std::array http_header_names = {
+#define COBRA_HTTP_HEADER_NAME(enumerator, name) std::string_view(name),
+			COBRA_HTTP_HEADERS(COBRA_HTTP_HEADER_NAME)
+#undef COBRA_HTTP_HEADER_NAME
+		};
+	} // namespace detail
+
+	inline constexpr std::size_t http_header_count = detail::http_header_names.size();
+
+	// header names are tokens, so folding ascii letters is enough to compare them without regard to case
+	constexpr char http_header_lower(char ch) {
+		return ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch;
+	}
+
+	constexpr bool http_header_equal(std::string_view a, std::string_view b) {
+		if (a.size() != b.size())
+			return false;
+
+		for (std::size_t i = 0; i < a.size(); ++i) {
+			if (http_header_lower(a[i]) != http_header_lower(b[i]))
+				return false;
+		}
+		return true;
+	}
+
+	namespace detail {
+		// Seeded FNV-1a over the folded name, reduced to a byte. The seed was searched for offline so that every known
+		// name gets a slot of its own, make_http_header_table refuses to compile if that ever stops being true.
+		inline constexpr std::uint32_t http_header_seed = 136189;
+
+		constexpr std::uint8_t http_header_hash(std::string_view name) {
+			std::uint32_t hash = http_header_seed;
+
+			for (char ch : name)
+				hash = (hash ^ static_cast<unsigned char>(http_header_lower(ch))) * 16777619u;
+			return static_cast<std::uint8_t>(hash ^ hash >> 16);
+		}
+
+		// not constexpr, calling it during constant evaluation makes the evaluation fail
+		inline void http_header_collision() {}
+
+		// slot to http_header plus one, 0 for slots no known name hashes to
+		constexpr std::array<std::uint8_t, 256> make_http_header_table() {
+			std::array<std::uint8_t, 256> table = {};
+
+			for (std::size_t i = 0; i < http_header_count; ++i) {
+				std::uint8_t& slot = table[http_header_hash(http_header_names[i])];
+
+				if (slot != 0)
+					http_header_collision();
+				slot = static_cast<std::uint8_t>(i + 1);
+			}
+			return table;
+		}
+
+		inline constexpr std::array<std::uint8_t, 256> http_header_table = make_http_header_table();
+	} // namespace detail
+
+	constexpr std::string_view http_header_name(http_header header) {
+		return detail::http_header_names[static_cast<std::size_t>(header)];
+	}
+
+	// the known header with the given name in any case, one hash and one comparison
+	constexpr std::optional<http_header> find_http_header(std::string_view name) {
+		const std::uint8_t slot = detail::http_header_table[detail::http_header_hash(name)];
+
+		if (slot != 0 && http_header_equal(detail::http_header_names[slot - 1], name))
+			return static_cast<http_header>(slot - 1);
+		return std::nullopt;
+	}
+} // namespace cobra
+
+#endif
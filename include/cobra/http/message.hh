@@ -1,10 +1,18 @@
 #ifndef COBRA_HTTP_MESSAGE_HH
 #define COBRA_HTTP_MESSAGE_HH
 
+#include "cobra/http/header.hh"
 #include "cobra/http/uri.hh"
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #define HTTP_OK 200
 #define HTTP_CREATED 201
@@ -69,23 +77,50 @@ namespace cobra {
 		http_version_type minor() const;
 	};
 
+	// Header fields in the order they were inserted. Keys are stored in their canonical case and looked up without
+	// regard to case. Known headers are found through a slot per http_header that points into the list, others by
+	// going through it. Everything lives in memory from the allocator the map was created with, a request parser
+	// hands out the arena of its connection here.
 	class http_header_map {
-		using map_type = std::unordered_map<http_header_key, http_header_value>;
+	public:
+		using allocator_type = std::pmr::polymorphic_allocator<>;
+		using value_type = std::pair<std::pmr::string, std::pmr::string>;
 
-		map_type _map;
+	private:
+		using list_type = std::pmr::vector<value_type>;
 
-	public:
-		using iterator = map_type::iterator;
-		using const_iterator = map_type::const_iterator;
+		list_type _list;
+		// index plus one in _list of every known header, 0 if it is not in there
+		std::array<std::uint16_t, http_header_count> _known = {};
 
-		const http_header_value& at(const http_header_key& key) const;
-		bool contains(const http_header_key& key) const;
-		bool insert(http_header_key key, http_header_value value);
-		void insert_or_assign(http_header_key key, http_header_value value);
+		std::size_t find(std::optional<http_header> header, std::string_view key) const;
+		void append(std::optional<http_header> header, std::string_view key, std::string_view value);
+
+	public:
+		using iterator = list_type::const_iterator;
+		using const_iterator = list_type::const_iterator;
+
+		http_header_map() = default;
+		explicit http_header_map(allocator_type alloc);
+		http_header_map(const http_header_map& other, allocator_type alloc);
+
+		allocator_type get_allocator() const;
+
+		// throws std::out_of_range if there is no field with the key
+		std::string_view at(std::string_view key) const;
+		std::string_view at(http_header header) const;
+		bool contains(std::string_view key) const;
+		bool contains(http_header header) const;
+		bool insert(std::string_view key, std::string_view value);
+		void insert_or_assign(std::string_view key, std::string_view value);
+		void insert_or_assign(http_header header, std::string_view value);
+		// adds the field or appends the value to the one already there after a comma, the way repeated field lines
+		// combine, true if the field is new
+		bool combine(std::string_view key, std::string_view value);
+		void reserve(std::size_t count);
+		std::size_t size() const;
 
-		iterator begin();
 		const_iterator begin() const;
-		iterator end();
 		const_iterator end() const;
 	};
 
@@ -94,15 +129,22 @@ namespace cobra {
 		http_header_map _header_map;
 
 	public:
-		http_message(http_version version);
+		using allocator_type = http_header_map::allocator_type;
+
+		http_message(http_version version, allocator_type alloc = {});
 
 		const http_version& version() const;
 		void set_version(http_version version);
 		const http_header_map& header_map() const;
 		void set_header_map(http_header_map header_map);
-		const http_header_value& header(const http_header_key& key) const;
-		bool has_header(const http_header_key& key) const;
-		void set_header(http_header_key key, http_header_value value);
+		std::string_view header(std::string_view key) const;
+		std::string_view header(http_header header) const;
+		bool has_header(std::string_view key) const;
+		bool has_header(http_header header) const;
+		void set_header(std::string_view key, std::string_view value);
+		void set_header(http_header header, std::string_view value);
+		bool combine_header(std::string_view key, std::string_view value);
+		void reserve_headers(std::size_t count);
 	};
 
 	class http_request : public http_message {
@@ -110,7 +152,7 @@ namespace cobra {
 		http_request_uri _uri;
 
 	public:
-		http_request(http_version version, http_request_method method, http_request_uri uri);
+		http_request(http_version version, http_request_method method, http_request_uri uri, allocator_type alloc = {});
 		http_request(http_request_method method, http_request_uri uri);
 
 		const http_request_method& method() const;
@@ -5,6 +5,8 @@
 #include "cobra/http/message.hh"
 #include "cobra/http/uri.hh"
 
+#include <memory_resource>
+
 namespace cobra {
 	constexpr std::size_t http_header_key_max_length = 256;
 	constexpr std::size_t http_header_value_max_length = 4096;
@@ -54,7 +56,9 @@ namespace cobra {
 	uri_authority parse_uri_authority(std::string_view string);
 	uri_asterisk parse_uri_asterisk(std::string_view string);
 	uri parse_uri(std::string_view string, const http_request_method& method);
-	task<http_request> parse_http_request(buffered_istream_reference stream);
+	// the request keeps its headers in memory from resource, typically the request_arena of the connection
+	task<http_request> parse_http_request(buffered_istream_reference stream,
+										  std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 	task<http_response> parse_http_response(buffered_istream_reference stream);
 	task<http_header_map> parse_cgi(buffered_istream_reference stream);
 }
@@ -0,0 +1,75 @@
+#ifndef COBRA_HTTP_SCAN_HH
+#define COBRA_HTTP_SCAN_HH
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+
+namespace cobra {
+	// Set of ASCII characters laid out for nibble lookups: bit h of column l is set if the character 0xhl is in the
+	// set. The vector kernels look up 16 or 32 bytes at once with two shuffles this way. Bytes of 128 and up are
+	// never in a set, none of the http character classes has any.
+	class http_char_set {
+		alignas(16) std::array<std::uint8_t, 16> _columns = {};
+
+	public:
+		template <std::predicate<char> Predicate>
+		explicit http_char_set(Predicate pred) {
+			for (int ch = 0; ch < 128; ++ch) {
+				if (pred(static_cast<char>(ch)))
+					_columns[ch & 15] |= 1 << (ch >> 4);
+			}
+		}
+
+		inline bool contains(char ch) const noexcept {
+			const unsigned char byte = static_cast<unsigned char>(ch);
+			return byte < 128 && (_columns[byte & 15] >> (byte >> 4) & 1);
+		}
+
+		inline const std::uint8_t* columns() const noexcept {
+			return _columns.data();
+		}
+	};
+
+	extern const http_char_set http_token_chars;
+	extern const http_char_set http_uri_chars;
+	extern const http_char_set http_ws_chars;
+	extern const http_char_set http_ctl_chars;
+	// whitespace and control characters, where a run of header value characters ends
+	extern const http_char_set http_value_delimiters;
+
+	enum class scan_kernel {
+		scalar,
+		ssse3,
+		avx2,
+	};
+
+	// the widest kernel the cpu supports, the one scan_while and scan_until use
+	scan_kernel active_scan_kernel() noexcept;
+	bool scan_kernel_supported(scan_kernel kernel) noexcept;
+
+	namespace detail {
+		using scan_function = std::size_t (*)(const http_char_set&, const char*, std::size_t) noexcept;
+
+		// picked when the program starts, scanning from a static constructor is not supported
+		extern const scan_function active_scan_while;
+		extern const scan_function active_scan_until;
+	} // namespace detail
+
+	// number of leading characters of data that are in set
+	inline std::size_t scan_while(const http_char_set& set, const char* data, std::size_t size) noexcept {
+		return detail::active_scan_while(set, data, size);
+	}
+
+	// number of leading characters of data that are not in set
+	inline std::size_t scan_until(const http_char_set& set, const char* data, std::size_t size) noexcept {
+		return detail::active_scan_until(set, data, size);
+	}
+
+	// same as above with a kernel of choice, which has to be supported, so that the kernels can be compared
+	std::size_t scan_while(scan_kernel kernel, const http_char_set& set, const char* data, std::size_t size) noexcept;
+	std::size_t scan_until(scan_kernel kernel, const http_char_set& set, const char* data, std::size_t size) noexcept;
+} // namespace cobra
+
+#endif
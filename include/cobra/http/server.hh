@@ -8,8 +8,11 @@
 #include "cobra/net/stream.hh"
 #include "cobra/config.hh"
 
-#include <optional>
+#include <chrono>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <stop_token>
 
 namespace cobra {
 
@@ -40,20 +43,34 @@ namespace cobra {
 		std::unordered_map<std::string, ssl_ctx> _contexts;
 		executor* _exec;
 		event_loop* _loop;
+		std::chrono::milliseconds _keepalive_timeout = default_keepalive_timeout;
+		std::size_t _keepalive_requests = default_keepalive_requests;
 
 		server() = delete;
 		server(config::listen_address address, std::unordered_map<std::string, ssl_ctx> contexts,
 			   std::vector<http_filter> handlers, executor* exec, event_loop* loop);
 
 	public:
-		task<void> start(executor* exec, event_loop *loop);
+		// reuse_port has to be set when other reactors listen on the same addresses
+		task<void> start(executor* exec, event_loop *loop, bool reuse_port = false);
 
 		static std::vector<server> convert(const std::vector<std::shared_ptr<config::server>>& configs,
 										   executor* exec, event_loop* loop);
 
+		static constexpr std::chrono::milliseconds default_keepalive_timeout = std::chrono::seconds(75);
+		static constexpr std::size_t default_keepalive_requests = 1000;
+		// most of a request body a kept alive connection reads and throws away after the handler left it, with more
+		// left (or more than the max_body_size of the location) the connection is closed instead
+		static constexpr std::size_t max_discard = 64 * 1024;
+
 	private:
 		task<void> on_connect(basic_socket_stream& socket);
-		task<void> handle_request(const http_filter& config, const http_request& request, const uri_abs_path& normalized, buffered_istream_reference in, http_response_writer writer);
+		// true if the connection can be used for another request afterwards. hangup is stopped once the client goes
+		// away while a backend works on its request.
+		task<bool> serve(basic_socket_stream& socket, buffered_istream_reference in, buffered_ostream_reference out,
+						 std::pmr::memory_resource* resource, bool last, std::stop_source& hangup);
+		task<void> handle_request(const http_filter& config, const http_request& request, const uri_abs_path& normalized, buffered_istream_reference in, http_response_writer writer,
+								  basic_socket_stream& socket, std::stop_source& hangup);
 	};
 }
 
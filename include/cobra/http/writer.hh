@@ -1,18 +1,55 @@
 #ifndef COBRA_HTTP_WRITER_HH
 #define COBRA_HTTP_WRITER_HH
 
+#include "cobra/asyncio/frame_allocator.hh"
 #include "cobra/asyncio/stream.hh"
 #include "cobra/asyncio/stream_buffer.hh"
 #include "cobra/http/message.hh"
 #include "cobra/net/stream.hh"
 
 namespace cobra {
+	// Sends every write as one chunk of the chunked transfer coding. The last chunk is left to whoever owns the
+	// connection, it is written once the handler is done with the body.
+	class http_chunked_ostream : public basic_ostream_impl<http_chunked_ostream, char> {
+		buffered_ostream_reference _stream;
+
+	public:
+		http_chunked_ostream(buffered_ostream_reference stream);
+
+		task<std::size_t> write(const char_type* data, std::size_t size);
+		task<void> flush();
+
+		// writes the last chunk and flushes
+		static task<void> finish(buffered_ostream_reference stream);
+	};
+
 	using http_istream = istream_variant<buffered_istream_reference, istream_limit<buffered_istream_reference>>;
-	using http_ostream = ostream_variant<buffered_ostream_reference, ostream_limit<buffered_ostream_reference>>;
+	using http_ostream = ostream_variant<buffered_ostream_reference, ostream_limit<buffered_ostream_reference>,
+										 http_chunked_ostream>;
+
+	// how the end of a response body is found by the client
+	enum class http_body_framing {
+		none,
+		length,
+		chunked,
+		close,
+	};
+
+	// Shared between a connection and the writer of its current response. The connection says what the client
+	// allows for, the writer fills in what it made of that once the head went out.
+	struct http_response_state {
+		bool keep_alive = false;
+		bool chunked = false;
+		bool sent = false;
+		http_body_framing framing = http_body_framing::close;
+	};
 
 	class http_server_logger {
 		const basic_socket_stream* _socket = nullptr;
 		const http_request* _request = nullptr;
+		// frame count at the start of the request, log() prints how many frames it took to get to a response. With
+		// several connections on one reactor it also counts whatever ran in between, so it is only exact under low load.
+		std::size_t _frames = frame_allocator::allocated();
 
 	public:
 		void set_socket(const basic_socket_stream& socket);
@@ -33,9 +70,12 @@ namespace cobra {
 	class http_response_writer {
 		buffered_ostream_reference _stream;
 		http_server_logger* _logger;
+		http_response_state* _state;
 
 	public:
-		http_response_writer(buffered_ostream_reference stream, http_server_logger* logger = nullptr);
+		// without a state every response closes the connection
+		http_response_writer(buffered_ostream_reference stream, http_server_logger* logger = nullptr,
+							 http_response_state* state = nullptr);
 
 		task<http_ostream> send(http_response response)&&;
 	};
@@ -6,10 +6,13 @@
 #include "cobra/net/address.hh"
 #include "cobra/config.hh"
 
+#include <chrono>
 #include <filesystem>
 #include <functional>
 #include <stdexcept>
 #include <mutex>
+#include <optional>
+#include <stop_token>
 #include <unordered_map>
 
 extern "C" {
@@ -31,6 +34,12 @@ namespace cobra {
 		virtual task<std::size_t> write(const char_type* data, std::size_t size) = 0;
 		virtual task<void> flush() = 0;
 		virtual task<void> shutdown(shutdown_how how) = 0;
+		// waits until a read would not block, throws timeout_exception if nothing came in within timeout
+		virtual task<void> wait_readable(std::optional<std::chrono::milliseconds> timeout) = 0;
+		// Returns true once the peer closed or reset the connection, or false as soon as there is unread data, which
+		// whoever reads the stream gets to before its end anyway. Does not get in the way of reads that run at the
+		// same time. Throws cancelled_exception if token is stopped first.
+		virtual task<bool> wait_hangup(std::stop_token token) = 0;
 		virtual address peername() const = 0;
 		virtual std::optional<std::string_view> server_name() const = 0;
 	};
@@ -39,6 +48,7 @@ namespace cobra {
 	class socket_stream : public basic_socket_stream {
 		event_loop* _loop;
 		file _file;
+		std::stop_token _token;
 
 		friend class ssl_socket_stream;
 	public:
@@ -50,9 +60,13 @@ namespace cobra {
 		task<std::size_t> write(const char_type* data, std::size_t size) override;
 		task<void> flush() override;
 		task<void> shutdown(shutdown_how how) override;
+		task<void> wait_readable(std::optional<std::chrono::milliseconds> timeout) override;
+		task<bool> wait_hangup(std::stop_token token) override;
 		address peername() const override;
 		std::optional<std::string_view> server_name() const override;
 		inline file leak() && { return std::move(_file); }
+		// reads and writes that are waiting when token is stopped throw cancelled_exception
+		inline void set_stop_token(std::stop_token token) { _token = std::move(token); }
 	};
 
 	class ssl_error : std::runtime_error {
@@ -148,6 +162,8 @@ namespace cobra {
 		task<std::size_t> write(const char_type* data, std::size_t size) override;
 		task<void> flush() override;
 		task<void> shutdown(shutdown_how how) override;
+		task<void> wait_readable(std::optional<std::chrono::milliseconds> timeout) override;
+		task<bool> wait_hangup(std::stop_token token) override;
 		address peername() const override;
 		std::optional<std::string_view> server_name() const override;
 
@@ -167,14 +183,17 @@ namespace cobra {
 
 	task<socket_stream> open_connection(event_loop* loop, const char* node, const char* service);
 	task<ssl_socket_stream> open_ssl_connection(executor* exec, event_loop* loop, const char* node, const char* service);
-	task<void> start_server(executor* exec, event_loop* loop, const char* node, const char* service,
-							std::function<task<void>(socket_stream)> cb);
+	// Connections are served on the thread of loop, which accepted them. reuse_port lets listeners of other reactors
+	// bind the same address, the kernel balances connections between them. Without it a second process on the
+	// address fails with EADDRINUSE instead of silently taking half the traffic.
+	task<void> start_server(event_loop* loop, const char* node, const char* service,
+							std::function<task<void>(socket_stream)> cb, bool reuse_port = false);
 	//TODO implement sessions? https://wiki.openssl.org/index.php/SSL_and_TLS_Protocols#Session_Resumption
 	task<void> start_ssl_server(ssl_ctx ctx, executor* exec, event_loop* loop, const char* node, const char* service,
-							std::function<task<void>(ssl_socket_stream)> cb);
+							std::function<task<void>(ssl_socket_stream)> cb, bool reuse_port = false);
 	task<void> start_ssl_server(std::unordered_map<std::string, ssl_ctx> server_names, executor* exec,
 								event_loop* loop, const char* node, const char* service,
-								std::function<task<void>(ssl_socket_stream)> cb);
+								std::function<task<void>(ssl_socket_stream)> cb, bool reuse_port = false);
 } // namespace cobra
 
 #endif
@@ -4,6 +4,8 @@
 #include "cobra/asyncio/event_loop.hh"
 #include "cobra/asyncio/stream.hh"
 
+#include <stop_token>
+
 namespace cobra {
 	enum class process_stream_type {
 		in,
@@ -36,6 +38,7 @@ namespace cobra {
 	class process : public process_ostream<process_stream_type::in>, public process_istream<process_stream_type::out>, public process_istream<process_stream_type::err> {
 		int _pid;
 		event_loop* _loop;
+		std::stop_token _token;
 
 	public:
 		process(event_loop* loop, int pid, file&& in, file&& out, file&& err);
@@ -46,12 +49,15 @@ namespace cobra {
 		process& operator=(process other);
 
 		event_loop* loop() const;
+		const std::stop_token& stop_token() const;
+		// reads and writes on the pipes that are waiting when token is stopped throw cancelled_exception
+		void set_stop_token(std::stop_token token);
 
 		process_ostream<process_stream_type::in>& in();
 		process_istream<process_stream_type::out>& out();
 		process_istream<process_stream_type::err>& err();
 
-		task<int> wait();
+		task<int> wait(std::optional<std::chrono::milliseconds> timeout = std::nullopt);
 	};
 
 	class command {
@@ -73,14 +79,22 @@ namespace cobra {
 
 	template <process_stream_type Type>
 	task<std::size_t> process_istream<Type>::read(typename process_istream<Type>::char_type* data, std::size_t size) {
-		co_await static_cast<process*>(this)->loop()->wait_read(*this);
-		co_return check_return(::read(fd(), data, size));
+		while (true) {
+			if (auto nread = check_would_block(::read(fd(), data, size)))
+				co_return *nread;
+			process* proc = static_cast<process*>(this);
+			co_await proc->loop()->wait_read(*this, std::nullopt, proc->stop_token());
+		}
 	}
 
 	template <process_stream_type Type>
 	task<std::size_t> process_ostream<Type>::write(const typename process_ostream<Type>::char_type* data, std::size_t size) {
-		co_await static_cast<process*>(this)->loop()->wait_write(*this);
-		co_return check_return(::write(fd(), data, size));
+		while (true) {
+			if (auto nwritten = check_would_block(::write(fd(), data, size)))
+				co_return *nwritten;
+			process* proc = static_cast<process*>(this);
+			co_await proc->loop()->wait_write(*this, std::nullopt, proc->stop_token());
+		}
 	}
 
 	template <process_stream_type Type>
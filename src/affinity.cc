@@ -0,0 +1,84 @@
+#include "cobra/affinity.hh"
+#include "cobra/exception.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <format>
+#include <stdexcept>
+
+extern "C" {
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+namespace cobra {
+	namespace {
+		unsigned parse_cpu(std::string_view& list) {
+			unsigned cpu = 0;
+			auto [end, ec] = std::from_chars(list.data(), list.data() + list.size(), cpu);
+
+			if (ec == std::errc::invalid_argument)
+				throw std::invalid_argument("expected a cpu number");
+			if (ec == std::errc::result_out_of_range || cpu > max_cpu)
+				throw std::invalid_argument(std::format("cpu numbers go up to {}", max_cpu));
+
+			list.remove_prefix(end - list.data());
+			return cpu;
+		}
+	} // namespace
+
+	std::vector<unsigned> parse_cpu_list(std::string_view list) {
+		std::vector<unsigned> cpus;
+
+		while (true) {
+			unsigned first = parse_cpu(list);
+			unsigned last = first;
+
+			if (list.starts_with('-')) {
+				list.remove_prefix(1);
+				last = parse_cpu(list);
+
+				if (last < first)
+					throw std::invalid_argument(std::format("empty cpu range {}-{}", first, last));
+			}
+
+			for (unsigned cpu = first; cpu <= last; ++cpu) {
+				if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end())
+					throw std::invalid_argument(std::format("cpu {} is listed twice", cpu));
+				cpus.push_back(cpu);
+			}
+
+			if (list.empty())
+				return cpus;
+			if (!list.starts_with(','))
+				throw std::invalid_argument("cpus must be separated by a `,`");
+			list.remove_prefix(1);
+		}
+	}
+
+	void pin_thread(unsigned cpu) {
+		const std::size_t size = CPU_ALLOC_SIZE(max_cpu + 1);
+		cpu_set_t* set = CPU_ALLOC(max_cpu + 1);
+
+		if (!set)
+			throw std::bad_alloc();
+
+		CPU_ZERO_S(size, set);
+		CPU_SET_S(cpu, size, set);
+		int rc = sched_setaffinity(0, size, set);
+		CPU_FREE(set);
+
+		if (rc == -1)
+			throw errno_exception();
+	}
+
+	void use_local_memory() {
+		// for a pinned thread local allocation means the node of its cpu. Set explicitly so that a policy inherited
+		// from the parent (numactl --interleave) does not apply to the reactor.
+		if (syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) == -1 && errno != ENOSYS)
+			throw errno_exception();
+	}
+} // namespace cobra
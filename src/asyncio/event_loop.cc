@@ -2,8 +2,10 @@
 
 #include "cobra/exception.hh"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <climits>
 #include <exception>
 #include <functional>
 #include <memory>
@@ -11,9 +13,17 @@
 #include <ranges>
 #include <stdexcept>
 #include <tuple>
+#include <utility>
+#include <vector>
 
 extern "C" {
+#include <fcntl.h>
+#include <signal.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 }
 
 namespace cobra {
@@ -22,50 +32,232 @@ namespace cobra {
 		return type == poll_type::read ? poll_type::write : poll_type::read;
 	}
 
+	event_loop::event_loop() : _wakeup(check_return(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {}
+
 	event_loop::~event_loop() {}
 
-	event_loop::event_type event_loop::wait_read(const file& fd, std::optional<std::chrono::milliseconds> timeout) {
-		return wait_ready(poll_type::read, fd, timeout);
+	event_loop::post_event::post_event(event_loop& loop)
+		: task_node([](task_node& node) { static_cast<post_event&>(node)._handle.resume(); }), _loop(loop) {}
+
+	void event_loop::post_event::await_suspend(std::coroutine_handle<> handle) {
+		_handle = handle;
+		_loop.get().post(*this);
+	}
+
+	void event_loop::post(task_node& node) {
+		task_node* head = _posted.load(std::memory_order_relaxed);
+
+		do {
+			node._next = head;
+		} while (!_posted.compare_exchange_weak(head, &node, std::memory_order_release, std::memory_order_relaxed));
+
+		// whoever made the inbox non empty wakes the loop, everybody after that is picked up by the same wakeup
+		if (!head) {
+			std::uint64_t one = 1;
+			check_return(::write(_wakeup.fd(), &one, sizeof one));
+		}
+	}
+
+	event_loop::post_type event_loop::post_to_loop() {
+		return post_event{*this};
+	}
+
+	const file& event_loop::wakeup_fd() const {
+		return _wakeup;
+	}
+
+	void event_loop::run_posted() {
+		std::uint64_t count;
+
+		// reset before the inbox is taken, a post that comes in after the exchange signals again
+		if (::read(_wakeup.fd(), &count, sizeof count) == -1 && errno != EAGAIN)
+			throw errno_exception();
+
+		task_node* node = _posted.exchange(nullptr, std::memory_order_acquire);
+		task_node* reversed = nullptr;
+
+		while (node) {
+			task_node* next = std::exchange(node->_next, reversed);
+			reversed = std::exchange(node, next);
+		}
+
+		while (reversed) {
+			// a node may free itself when it runs
+			task_node* next = std::exchange(reversed->_next, nullptr);
+			reversed->run();
+			reversed = next;
+		}
 	}
 
-	event_loop::event_type event_loop::wait_write(const file& fd, std::optional<std::chrono::milliseconds> timeout) {
-		return wait_ready(poll_type::write, fd, timeout);
+	event_loop::event_type event_loop::wait_read(const file& fd, std::optional<std::chrono::milliseconds> timeout,
+												 std::stop_token token) {
+		return wait_ready(poll_type::read, fd, timeout, std::move(token));
+	}
+
+	event_loop::event_type event_loop::wait_write(const file& fd, std::optional<std::chrono::milliseconds> timeout,
+												  std::stop_token token) {
+		return wait_ready(poll_type::write, fd, timeout, std::move(token));
 	}
 
 	event_loop::event_type event_loop::wait_ready(poll_type type, const file& fd,
-												  std::optional<std::chrono::milliseconds> timeout) {
-		return event_loop::event_loop_event{*this, std::make_pair(fd.fd(), type), timeout};
+												  std::optional<std::chrono::milliseconds> timeout,
+												  std::stop_token token) {
+		register_file(fd);
+		return event_loop::event_loop_event{*this, std::make_pair(fd.fd(), type), timeout, std::move(token), {}};
 	}
 
-	task<int> event_loop::wait_pid(int pid, std::optional<std::chrono::milliseconds> timeout) {
-		int result;
-		
+	void event_loop::register_file(const file& fd) {
+		(void) fd;
+	}
+
+	// glibc only wraps pidfd_open(2) since 2.36, older kernels do not have it at all
+	static std::optional<file> open_pidfd(int pid) {
+#ifdef SYS_pidfd_open
+		int fd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+
+		if (fd >= 0)
+			return file(fd);
+		if (errno != ENOSYS)
+			throw errno_exception();
+#else
+		(void) pid;
+#endif
+		return std::nullopt;
+	}
+
+	static std::optional<int> try_wait_pid(int pid) {
+		int status;
+
 		while (true) {
-			int ret = waitpid(pid, &result, 0); // TODO: very very very bad
-			
-			if (ret >= 0) {
-				break;
+			int ret = waitpid(pid, &status, WNOHANG);
+
+			if (ret == pid) {
+				return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+			} else if (ret == 0) {
+				return std::nullopt;
 			} else if (errno != EINTR) {
 				throw errno_exception();
 			}
 		}
+	}
+
+	task<int> event_loop::wait_pid(int pid, std::optional<std::chrono::milliseconds> timeout) {
+		using clock = std::chrono::steady_clock;
+		constexpr std::chrono::milliseconds max_backoff(100);
 
-		(void) timeout;
-		co_return WEXITSTATUS(result);
+		std::optional<clock::time_point> deadline;
+		std::optional<file> pidfd = open_pidfd(pid);
+		std::chrono::milliseconds backoff(1);
+
+		if (timeout)
+			deadline = clock::now() + *timeout;
+
+		while (true) {
+			if (std::optional<int> status = try_wait_pid(pid))
+				co_return *status;
+
+			std::optional<std::chrono::milliseconds> remaining;
+
+			if (deadline) {
+				clock::time_point now = clock::now();
+
+				if (now >= *deadline) {
+					// the child is not reaped yet so the pid can not have been reused
+					check_return(kill(pid, SIGKILL));
+					deadline.reset();
+					continue;
+				}
+				remaining = std::chrono::ceil<std::chrono::milliseconds>(*deadline - now);
+			}
+
+			if (pidfd) {
+				// a pidfd becomes readable once the child exits
+				try {
+					co_await wait_read(*pidfd, remaining);
+				} catch (const timeout_exception&) {
+				}
+			} else {
+				co_await sleep_for(remaining ? std::min(backoff, *remaining) : backoff);
+				backoff = std::min(backoff * 2, max_backoff);
+			}
+		}
+	}
+
+	task<std::size_t> event_loop::recv(const file& fd, char* data, std::size_t size, std::stop_token token) {
+		while (true) {
+			if (auto nread = check_would_block(::recv(fd.fd(), data, size, 0)))
+				co_return *nread;
+			co_await wait_read(fd, std::nullopt, token);
+		}
+	}
+
+	task<std::size_t> event_loop::send(const file& fd, const char* data, std::size_t size, std::stop_token token) {
+		while (true) {
+			if (auto nwritten = check_would_block(::send(fd.fd(), data, size, 0)))
+				co_return *nwritten;
+			co_await wait_write(fd, std::nullopt, token);
+		}
+	}
+
+	task<file> event_loop::accept(const file& fd) {
+		while (true) {
+			if (auto client = check_would_block(::accept4(fd.fd(), nullptr, nullptr, SOCK_NONBLOCK)))
+				co_return file(static_cast<int>(*client));
+			co_await wait_read(fd);
+		}
+	}
+
+	task<bool> event_loop::connect(const file& fd, const sockaddr* addr, socklen_t len) {
+		check_return(::connect(fd.fd(), addr, len));
+		co_await wait_write(fd);
+
+		int error;
+		socklen_t error_len = sizeof error;
+		check_return(getsockopt(fd.fd(), SOL_SOCKET, SO_ERROR, &error, &error_len));
+		co_return error == 0;
 	}
 
 	void event_loop::event_loop_event::operator()(event_handle<void>& handle) {
+		if (_token.stop_requested()) {
+			handle.set_exception(std::make_exception_ptr(cancelled_exception()));
+			return;
+		}
+
 		_loop.get().schedule_event(_event, _timeout, handle);
+
+		// armed after scheduling so that there is something to cancel, a stop that came in between cancels right away
+		if (_token.stop_possible())
+			_cancel.arm(_token, event_canceller{&_loop.get(), _event, &handle});
 	}
 
-	epoll_event_loop::epoll_event_loop(executor& exec) : _epoll_fd(epoll_create(1)), _exec(exec) {
+	void event_loop::event_canceller::operator()() const noexcept {
+		_loop->cancel_event(_event, *_handle);
+	}
+
+	event_loop::sleep_type event_loop::sleep_for(std::chrono::milliseconds duration) {
+		return sleep_until(std::chrono::steady_clock::now() + duration);
+	}
+
+	event_loop::sleep_type event_loop::sleep_until(std::chrono::steady_clock::time_point deadline) {
+		return event_loop::sleep_event{*this, deadline, {}};
+	}
+
+	void event_loop::sleep_event::operator()(event_handle<void>& handle) {
+		_loop.get().schedule_sleep(_deadline, _timer, handle);
+	}
+
+	epoll_event_loop::epoll_event_loop(executor& exec, std::size_t max_events)
+		: _epoll_fd(epoll_create(1)), _exec(exec), _events(min_events),
+		  _max_events(std::clamp<std::size_t>(max_events, min_events, INT_MAX)) {
 		if (_epoll_fd.fd() == -1)
 			throw errno_exception();
-	}
 
-	epoll_event_loop::epoll_event_loop(epoll_event_loop&& other) noexcept
-		: _epoll_fd(std::move(other._epoll_fd)), _exec(other._exec), _write_events(std::move(other._write_events)),
-		  _read_events(std::move(other._read_events)) {}
+		// not a registration, posted work is run straight from poll()
+		epoll_event epoll_event;
+		epoll_event.events = EPOLLIN | EPOLLET;
+		epoll_event.data.fd = wakeup_fd().fd();
+		check_return(epoll_ctl(_epoll_fd.fd(), EPOLL_CTL_ADD, wakeup_fd().fd(), &epoll_event));
+	}
 
 	void epoll_event_loop::schedule_event(event_pair event, std::optional<std::chrono::milliseconds> timeout,
 										  event_handle<void>& handle) {
@@ -73,12 +265,85 @@ namespace cobra {
 
 		if (timeout)
 			converted = clock::duration(*timeout);
-		add_event(event, converted, handle);
+
+		if (add_event(event, converted, handle))
+			handle.set_value(_exec.get(), priority::io);
+	}
+
+	void epoll_event_loop::schedule_sleep(time_point deadline, loop_timer& timer, event_handle<void>& handle) {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		timer.handle = &handle;
+		timer.event.reset();
+		_timers.insert(timer, deadline);
+	}
+
+	void epoll_event_loop::register_file(const file& fd) {
+		if (fd.observer() == this)
+			return;
+
+		epoll_event epoll_event;
+		epoll_event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		epoll_event.data.fd = fd.fd();
+
+		if (epoll_ctl(_epoll_fd.fd(), EPOLL_CTL_ADD, fd.fd(), &epoll_event) == -1 && errno != EEXIST)
+			throw errno_exception();
+
+		// the slot may have belonged to an earlier file with the same number
+		slot& slot = _slots[fd.fd()];
+		slot.read.store(idle_state, std::memory_order_relaxed);
+		slot.write.store(idle_state, std::memory_order_relaxed);
+		slot.registered.store(true, std::memory_order_release);
+		fd.set_observer(this);
 	}
 
-	std::vector<epoll_event> epoll_event_loop::epoll(std::size_t count, std::optional<clock::duration> timeout) {
-		std::vector<epoll_event> events(count);
+	void epoll_event_loop::file_closed(int fd) noexcept {
+		std::vector<std::reference_wrapper<future_type>> orphans;
+		slot* slot = _slots.find(fd);
+
+		if (!slot || !slot->registered.exchange(false, std::memory_order_acq_rel))
+			return;
+
+		for (poll_type type : {poll_type::read, poll_type::write}) {
+			slot_state state = slot->state(type).exchange(idle_state, std::memory_order_acq_rel);
 
+			if (state == idle_state || state == ready_state)
+				continue;
+
+			future_type* handle = reinterpret_cast<future_type*>(state & ~state_tag_mask);
+			if (state & timed_tag)
+				cancel_timer(*slot, type, handle);
+			orphans.push_back(*handle);
+		}
+
+		// the description may outlive this fd when it was inherited by a child process
+		epoll_ctl(_epoll_fd.fd(), EPOLL_CTL_DEL, fd, nullptr);
+
+		for (auto&& orphan : orphans)
+			orphan.get().set_exception(std::make_exception_ptr(errno_exception(EBADF)), _exec.get(), priority::io);
+	}
+
+	void epoll_event_loop::cancel_event(event_pair event, event_handle<void>& handle) noexcept {
+		slot* slot = _slots.find(event.first);
+
+		if (!slot)
+			return;
+
+		std::atomic<slot_state>& state = slot->state(event.second);
+		const slot_state waiting = reinterpret_cast<slot_state>(&handle);
+
+		// only the handle itself is taken out, whatever else is in the slot belongs to somebody else
+		for (slot_state expected : {waiting, waiting | timed_tag}) {
+			if (state.compare_exchange_strong(expected, idle_state, std::memory_order_acq_rel)) {
+				if (expected & timed_tag)
+					cancel_timer(*slot, event.second, &handle);
+				handle.set_exception(std::make_exception_ptr(cancelled_exception()), _exec.get(), priority::io);
+				return;
+			}
+		}
+	}
+
+	std::size_t epoll_event_loop::epoll(std::optional<clock::duration> timeout) {
 		std::optional<time_point> timeout_point;
 
 		auto now = clock::now();
@@ -87,17 +352,21 @@ namespace cobra {
 			timeout_point = now + timeout.value();
 
 		while (true) {
-			auto epoll_timeout = clock::duration(std::chrono::milliseconds(-1));
+			auto epoll_timeout = std::chrono::milliseconds(-1);
 			if (timeout_point.has_value())
-				epoll_timeout = timeout_point.value() - now;
+				epoll_timeout = std::max(std::chrono::ceil<std::chrono::milliseconds>(timeout_point.value() - now),
+										 std::chrono::milliseconds(0));
 
-			int rc = epoll_wait(_epoll_fd.fd(), events.data(), count, epoll_timeout.count());
+			const time_point start = clock::now();
+			int rc = epoll_wait(_epoll_fd.fd(), _events.data(), static_cast<int>(_events.size()),
+								epoll_timeout.count());
+			_counters.wait_time.record(clock::now() - start);
 
 			if (rc == -1) {
 				if (errno == EINTR) {
 					now = clock::now();
 					if (clock::now() >= timeout_point.value_or(time_point::max())) {
-						return std::vector<epoll_event>();
+						return 0;
 					} else {
 						continue;
 					}
@@ -105,179 +374,205 @@ namespace cobra {
 					throw errno_exception();
 				}
 			} else {
-				events.resize(rc);
-				return events;
+				_counters.waits.add();
+				_counters.events.add(rc);
+				_counters.events_per_batch.record(static_cast<std::uint64_t>(rc));
+				return rc;
 			}
 		}
 	}
 
-	generator<std::pair<int, poll_type>> epoll_event_loop::convert(epoll_event event) {
-		int fd = event.data.fd;
-
-		if (event.events & (EPOLLERR | EPOLLHUP)) {
-			co_yield {fd, poll_type::read};
-			co_yield {fd, poll_type::write};
-		} else {
-			if (event.events & EPOLLIN) {
-				co_yield {fd, poll_type::read};
-			}
-
-			if (event.events & EPOLLOUT) {
-				co_yield {fd, poll_type::write};
+	void epoll_event_loop::resize_events(std::size_t count) {
+		const std::size_t size = _events.size();
+
+		if (count == size && size < _max_events) {
+			_events.resize(std::min(size * 2, _max_events));
+			_underused = 0;
+		} else if (count < size / 4 && size > min_events) {
+			if (++_underused >= shrink_after) {
+				_events.resize(std::max(size / 2, min_events));
+				_events.shrink_to_fit();
+				_underused = 0;
 			}
+		} else {
+			_underused = 0;
 		}
-
-		co_return;
 	}
 
-	std::vector<epoll_event_loop::event_pair> epoll_event_loop::poll(std::size_t count,
-																	 std::optional<clock::duration> timeout) {
-		std::vector<epoll_event> events = epoll(count, timeout);
-		std::vector<event_pair> result;
-		result.reserve(events.size());
+	void epoll_event_loop::dispatch(const epoll_event& event, time_point ready) {
+		// errors and hangups wake up both directions, whatever gets retried reports them
+		constexpr std::uint32_t both = EPOLLERR | EPOLLHUP;
+		constexpr std::uint32_t read_events = EPOLLIN | EPOLLRDHUP | both;
+		constexpr std::uint32_t write_events = EPOLLOUT | both;
 
-		for (auto&& event : events) {
-			for (auto&& conv : convert(event)) {
-				result.push_back(conv);
-			}
-		}
-		return result;
+		slot* slot = _slots.find(event.data.fd);
+
+		if (!slot || !slot->registered.load(std::memory_order_acquire))
+			return;
+
+		future_type* reader = event.events & read_events ? take_waiter(*slot, poll_type::read) : nullptr;
+		future_type* writer = event.events & write_events ? take_waiter(*slot, poll_type::write) : nullptr;
+
+		if (reader || writer)
+			_counters.lag.record(clock::now() - ready);
+		if (reader)
+			reader->set_value(_exec.get(), priority::io);
+		if (writer)
+			writer->set_value(_exec.get(), priority::io);
 	}
 
 	void epoll_event_loop::poll() {
 		std::optional<clock::duration> timeout;
 
 		auto now = clock::now();
+		auto expired = expire(now);
+
+		// resumed without going to sleep afterwards, as the waiters will most likely arm a new timer that the
+		// timeout below would not account for
+		if (!expired.empty()) {
+			for (auto&& [handle, exception] : expired) {
+				if (exception)
+					handle.get().set_exception(exception, _exec.get(), priority::io);
+				else
+					handle.get().set_value(_exec.get(), priority::io);
+			}
+			return;
+		}
 
 		_mutex.lock();
-		remove_before(now);
-
-		std::optional<time_point> timeout_point = get_timeout();
+		std::optional<time_point> timeout_point = _timers.next_deadline();
 		if (timeout_point)
 			timeout = *timeout_point - now;
 		_mutex.unlock();
 
-		event_list events = poll(10, timeout);
-
-		for (auto&& event : events) {
-			auto future = remove_event(event);
+		std::size_t count = epoll(timeout);
+		const time_point ready = clock::now();
 
-			if (future) {
-				auto handle = future.value();
-				_exec.get().schedule([handle]() {
-					handle.get().set_value();
-				});
+		for (std::size_t i = 0; i < count; ++i) {
+			if (_events[i].data.fd == wakeup_fd().fd()) {
+				run_posted();
+				continue;
 			}
+
+			dispatch(_events[i], ready);
 		}
+
+		// only after the events were handled, they live in the array
+		resize_events(count);
 	}
 
-	void epoll_event_loop::remove_before(std::unordered_map<int, timed_future>& map, time_point point) {
-		for (auto it = map.begin(); it != map.end();) {
-			if (it->second.timeout.value_or(time_point::max()) <= point) {
-				auto event = map.find(it->first);
+	epoll_event_loop::poll_stats& epoll_event_loop::poll_stats::operator+=(const poll_stats& other) noexcept {
+		waits += other.waits;
+		events += other.events;
+		wait_time += other.wait_time;
+		events_per_batch += other.events_per_batch;
+		lag += other.lag;
+		return *this;
+	}
 
-				event->second.future.get().set_exception(std::make_exception_ptr(timeout_exception()));
+	epoll_event_loop::poll_stats epoll_event_loop::stats() const {
+		poll_stats result;
 
-				map.erase(it++);
-			} else {
-				++it;
-			}
-		}
+		result.waits = _counters.waits.get();
+		result.events = _counters.events.get();
+		result.wait_time = _counters.wait_time.snapshot();
+		result.events_per_batch = _counters.events_per_batch.snapshot();
+		result.lag = _counters.lag.snapshot();
+		return result;
 	}
 
-	void epoll_event_loop::remove_before(time_point point) {
-		remove_before(get_map(poll_type::read), point);
-		remove_before(get_map(poll_type::write), point);
-	}
+	std::vector<std::pair<std::reference_wrapper<epoll_event_loop::future_type>, std::exception_ptr>>
+	epoll_event_loop::expire(time_point now) {
+		std::vector<std::pair<std::reference_wrapper<future_type>, std::exception_ptr>> expired;
+		std::lock_guard<std::mutex> lock(_mutex);
 
-	std::optional<epoll_event_loop::time_point>
-	epoll_event_loop::get_timeout(const std::unordered_map<int, timed_future>& map) {
-		std::optional<time_point> timeout;
+		while (timer_node* node = _timers.pop_expired(now)) {
+			loop_timer& timer = static_cast<loop_timer&>(*node);
 
-		for (auto&& [fd, future] : map) {
-			if (future.timeout) {
-				if (timeout) {
-					if (future.timeout < timeout)
-						timeout = future.timeout;
-				} else {
-					timeout = future.timeout;
-				}
+			if (!timer.event) {
+				expired.emplace_back(*timer.handle, nullptr);
+				continue;
 			}
-		}
-		return timeout;
-	}
 
-	std::optional<epoll_event_loop::time_point> epoll_event_loop::get_timeout() {
-		std::optional<time_point> write = get_timeout(get_map(poll_type::read));
-		std::optional<time_point> read = get_timeout(get_map(poll_type::write));
+			// a dispatch that got to the waiter first wakes it up instead
+			event_pair event = *timer.event;
+			slot_state state = reinterpret_cast<slot_state>(timer.handle) | timed_tag;
 
-		if (write && read) {
-			return std::min(read, write);
-		} else if (write) {
-			return write;
-		} else {
-			return read;
+			if (_slots[event.first].state(event.second).compare_exchange_strong(state, idle_state,
+																				std::memory_order_acq_rel))
+				expired.emplace_back(*timer.handle, std::make_exception_ptr(timeout_exception()));
 		}
+		return expired;
 	}
 
-	void epoll_event_loop::add_event(event_pair event, std::optional<clock::duration> timeout, future_type& future) {
-		std::optional<time_point> timeout_point;
+	bool epoll_event_loop::add_event(event_pair event, std::optional<clock::duration> timeout, future_type& future) {
+		static_assert(alignof(future_type) > state_tag_mask, "the low bits of a handle hold the state tag");
 
-		if (timeout)
-			timeout_point = clock::now() + *timeout;
+		slot* slot = _slots.find(event.first);
+		if (!slot || !slot->registered.load(std::memory_order_acquire))
+			throw std::invalid_argument("Waiting on an fd that was not registered");
 
-		std::lock_guard<std::mutex> lock(_mutex);
+		std::atomic<slot_state>& state = slot->state(event.second);
+		slot_state waiting = reinterpret_cast<slot_state>(&future);
+		std::unique_lock<std::mutex> lock;
 
-		bool is_mod = get_map(!event.second).contains(event.first);
-		if (!get_map(event.second).emplace(std::make_pair(event.first, timed_future{future, timeout_point})).second) {
-			throw std::invalid_argument("A future already exists for this event");
+		// the timer has to be armed before a dispatch or expire can see the tagged handle
+		if (timeout) {
+			lock = std::unique_lock<std::mutex>(_mutex);
+			waiting |= timed_tag;
 		}
 
-		epoll_event epoll_event;
-		epoll_event.events = event_to_epoll(event.second);
-		epoll_event.data.fd = event.first;
-
-		int rc = 0;
-		if (is_mod) {
-			epoll_event.events |= event_to_epoll(!event.second);
-			rc = epoll_ctl(_epoll_fd.fd(), EPOLL_CTL_MOD, epoll_event.data.fd, &epoll_event);
-		} else {
-			rc = epoll_ctl(_epoll_fd.fd(), EPOLL_CTL_ADD, epoll_event.data.fd, &epoll_event);
+		slot_state expected = state.load(std::memory_order_acquire);
+		while (true) {
+			if (expected == ready_state) {
+				if (state.compare_exchange_weak(expected, idle_state, std::memory_order_acq_rel))
+					return true;
+			} else if (expected == idle_state) {
+				if (state.compare_exchange_weak(expected, waiting, std::memory_order_acq_rel))
+					break;
+			} else {
+				throw std::invalid_argument("A future already exists for this event");
+			}
 		}
 
-		if (rc == -1) {
-			get_map(event.second).erase(event.first);
-			throw errno_exception();
+		if (timeout) {
+			loop_timer& timer = slot->timer(event.second);
+			timer.handle = &future;
+			timer.event = event;
+			_timers.insert(timer, clock::now() + *timeout);
 		}
+		return false;
 	}
 
-	std::optional<std::reference_wrapper<epoll_event_loop::future_type>>
-	epoll_event_loop::remove_event(event_pair event) {
-		std::lock_guard<std::mutex> lock(_mutex);
+	epoll_event_loop::future_type* epoll_event_loop::take_waiter(slot& slot, poll_type type) {
+		std::atomic<slot_state>& state = slot.state(type);
+		slot_state expected = state.load(std::memory_order_acquire);
 
-		auto it = get_map(event.second).find(event.first);
-		bool is_mod = get_map(!event.second).contains(event.first);
+		while (true) {
+			if (expected == ready_state)
+				return nullptr;
 
-		if (it == get_map(event.second).end()) {
-			return std::nullopt;
+			// nobody is interested yet, the edge would be lost otherwise
+			slot_state desired = expected == idle_state ? ready_state : idle_state;
+			if (state.compare_exchange_weak(expected, desired, std::memory_order_acq_rel))
+				break;
 		}
 
-		auto result = it->second.future;
+		if (expected == idle_state)
+			return nullptr;
 
-		get_map(event.second).erase(it);
+		future_type* handle = reinterpret_cast<future_type*>(expected & ~state_tag_mask);
+		if (expected & timed_tag)
+			cancel_timer(slot, type, handle);
+		return handle;
+	}
 
-		int rc = 0;
-		if (is_mod) {
-			epoll_event epoll_event;
-			epoll_event.events = event_to_epoll(!event.second);
-			epoll_event.data.fd = event.first;
-			rc = epoll_ctl(_epoll_fd.fd(), EPOLL_CTL_MOD, event.first, &epoll_event);
-		} else {
-			rc = epoll_ctl(_epoll_fd.fd(), EPOLL_CTL_DEL, event.first, nullptr);
-		}
+	void epoll_event_loop::cancel_timer(slot& slot, poll_type type, future_type* handle) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		loop_timer& timer = slot.timer(type);
 
-		if (rc == -1)
-			throw errno_exception();
-		return result;
+		// a no-op when expire popped it already but lost the race for the handle
+		if (timer.handle == handle)
+			_timers.cancel(timer);
 	}
 } // namespace cobra
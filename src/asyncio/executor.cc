@@ -1,24 +1,39 @@
 #include "cobra/asyncio/executor.hh"
 
+#include <algorithm>
+#include <chrono>
 #include <mutex>
+#include <utility>
 
 namespace cobra {
-	void executor::executor_event::operator()(event_handle<void>& handle) {
-		_exec.get().schedule([&handle]() {
-			handle.set_value();
-		});
+	void executor::executor_event::await_suspend(std::coroutine_handle<> handle) {
+		_exec.get().schedule(handle, _priority);
 	}
 
 	executor::~executor() {}
 
-	executor::event_type executor::schedule() {
-		return executor_event{*this};
+	executor::event_type executor::schedule(priority prio) {
+		return executor_event{*this, prio};
 	}
 
-	void sequential_executor::schedule(std::function<void()> func) {
+	void sequential_executor::schedule(std::function<void()> func, priority prio) {
+		(void) prio;
 		func();
 	}
 
+	void sequential_executor::schedule(std::coroutine_handle<> handle, priority prio) {
+		(void) prio;
+		handle.resume();
+	}
+
+	void sequential_executor::schedule(task_node& node, priority prio) {
+		(void) prio;
+		node.run();
+	}
+
+	// the worker running on this thread, if any
+	static thread_local void* current_worker = nullptr;
+
 	thread_pool_executor::thread_pool_executor() {
 		create_threads(std::jthread::hardware_concurrency());
 	}
@@ -33,39 +48,286 @@ namespace cobra {
 		}
 
 		{
-			std::lock_guard lock(_mutex);
+			std::lock_guard lock(_sleep_mutex);
 			_condition_variable.notify_all();
 		}
 
 		_threads.clear();
+
+		for (auto&& self : _workers) {
+			destroy_item(self->lifo);
+			for (auto& deque : self->deques) {
+				while (item work = deque.pop())
+					destroy_item(work);
+			}
+		}
+
+		for (inject_queue& queue : _inject) {
+			for (item work : queue.items)
+				destroy_item(work);
+		}
+	}
+
+	void thread_pool_executor::schedule(std::function<void()> func, priority prio) {
+		push(reinterpret_cast<item>(new job(std::move(func))) | job_tag, prio);
 	}
 
-	void thread_pool_executor::schedule(std::function<void()> func) {
-		std::lock_guard lock(_mutex);
-		_queue.emplace(func);
-		_condition_variable.notify_one();
+	void thread_pool_executor::schedule(std::coroutine_handle<> handle, priority prio) {
+		push(reinterpret_cast<item>(handle.address()) | handle_tag, prio);
+	}
+
+	void thread_pool_executor::schedule(task_node& node, priority prio) {
+		push(reinterpret_cast<item>(&node) | node_tag, prio);
+	}
+
+	void thread_pool_executor::push(item work, priority prio) {
+		worker* self = static_cast<worker*>(current_worker);
+
+		if (self && self->pool == this) {
+			if (prio == priority::bulk) {
+				self->deques[static_cast<std::size_t>(prio)].push(work);
+			} else {
+				// only the previous occupant of the slot becomes visible to other workers
+				item previous = std::exchange(self->lifo, work);
+				priority previous_priority = std::exchange(self->lifo_priority, prio);
+
+				if (!previous)
+					return;
+				self->deques[static_cast<std::size_t>(previous_priority)].push(previous);
+			}
+		} else {
+			inject_queue& queue = _inject[static_cast<std::size_t>(prio)];
+			std::lock_guard lock(queue.mutex);
+			queue.items.push_back(work);
+			queue.size.fetch_add(1, std::memory_order_relaxed);
+			queue.pushed.add();
+		}
+
+		notify_sleeper();
+	}
+
+	void thread_pool_executor::run_item(item work) {
+		void* ptr = reinterpret_cast<void*>(work & ~tag_mask);
+
+		switch (work & tag_mask) {
+		case job_tag: {
+			std::unique_ptr<job> func(static_cast<job*>(ptr));
+			(*func)();
+			break;
+		}
+		case handle_tag:
+			std::coroutine_handle<>::from_address(ptr).resume();
+			break;
+		case node_tag:
+			static_cast<task_node*>(ptr)->run();
+			break;
+		}
+	}
+
+	// handles and nodes are owned by whoever scheduled them, only jobs belong to the pool
+	void thread_pool_executor::destroy_item(item work) {
+		if (work && (work & tag_mask) == job_tag)
+			delete reinterpret_cast<job*>(work);
+	}
+
+	void thread_pool_executor::notify_sleeper() {
+		// pairs with the fence in run, either we see the sleeper or the sleeper sees the job
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (_sleepers.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard lock(_sleep_mutex);
+			_condition_variable.notify_one();
+		}
 	}
 
 	void thread_pool_executor::create_threads(std::size_t count) {
+		count = std::max<std::size_t>(count, 1);
+
 		for (std::size_t i = 0; i < count; i++) {
-			_threads.emplace_back([this](std::stop_token stop_token) {
-				std::unique_lock lock(_mutex);
-
-				while (!stop_token.stop_requested()) {
-					if (!_queue.empty()) {
-						auto func = _queue.front();
-						_queue.pop();
-						lock.unlock();
-						func();
-						lock.lock();
-						continue;
-					}
-
-					_condition_variable.wait(lock);
-				}
+			auto self = std::make_unique<worker>();
+			self->pool = this;
+			self->index = i;
+			self->seed = 0x9e3779b97f4a7c15 * (i + 1);
+			_workers.push_back(std::move(self));
+		}
+
+		for (auto&& self : _workers) {
+			_threads.emplace_back([this, &self = *self](std::stop_token stop_token) {
+				run(self, stop_token);
 			});
 		}
 	}
-	
+
+	void thread_pool_executor::run(worker& self, std::stop_token stop_token) {
+		current_worker = &self;
+
+		while (!stop_token.stop_requested()) {
+			item work = find_item(self);
+
+			for (int round = 0; !work && round < spin_rounds; ++round) {
+				std::this_thread::yield();
+				work = find_item(self);
+			}
+
+			if (work) {
+				self.queue_depth.record(queue_depth(self));
+
+				auto start = std::chrono::steady_clock::now();
+				run_item(work);
+				self.run_time.record(std::chrono::steady_clock::now() - start);
+				self.tasks.add();
+				continue;
+			}
+
+			std::unique_lock lock(_sleep_mutex);
+			_sleepers.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (!has_stealable_item() && !stop_token.stop_requested()) {
+				_condition_variable.wait(lock);
+				self.wakeups.add();
+			}
+			_sleepers.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		current_worker = nullptr;
+	}
+
+	thread_pool_executor::item thread_pool_executor::find_item(worker& self) {
+		static constexpr std::array<priority, lane_count> io_first = {priority::io, priority::normal, priority::bulk};
+		static constexpr std::array<priority, lane_count> normal_first = {priority::normal, priority::io, priority::bulk};
+		static constexpr std::array<priority, lane_count> bulk_first = {priority::bulk, priority::io, priority::normal};
+
+		self.picks += 1;
+
+		const std::array<priority, lane_count>* order = &io_first;
+
+		if (self.picks % bulk_interval == 0)
+			order = &bulk_first;
+		else if (self.picks % normal_interval == 0)
+			order = &normal_first;
+
+		for (priority prio : *order) {
+			if (item work = find_item(self, prio))
+				return work;
+		}
+		return 0;
+	}
+
+	thread_pool_executor::item thread_pool_executor::find_item(worker& self, priority prio) {
+		auto& deque = self.deques[static_cast<std::size_t>(prio)];
+
+		if (self.lifo && self.lifo_priority == prio) {
+			if (self.lifo_streak < lifo_budget) {
+				self.lifo_streak += 1;
+				return std::exchange(self.lifo, 0);
+			}
+
+			// the deque pops its newest item, so injected work is looked at first or the slot would win again
+			deque.push(std::exchange(self.lifo, 0));
+			self.lifo_streak = 0;
+
+			if (item work = take_injected(prio))
+				return work;
+			return deque.pop();
+		}
+
+		item work = deque.pop();
+
+		if (!work)
+			work = take_injected(prio);
+		if (!work)
+			work = steal(self, prio);
+		// an empty lane does not end the streak, the slot may hold work of the next one
+		if (work)
+			self.lifo_streak = 0;
+		return work;
+	}
+
+	thread_pool_executor::item thread_pool_executor::take_injected(priority prio) {
+		inject_queue& queue = _inject[static_cast<std::size_t>(prio)];
+
+		if (queue.size.load(std::memory_order_relaxed) == 0)
+			return 0;
+
+		std::lock_guard lock(queue.mutex);
+
+		if (queue.items.empty())
+			return 0;
+
+		item work = queue.items.front();
+		queue.items.pop_front();
+		queue.size.fetch_sub(1, std::memory_order_relaxed);
+		return work;
+	}
+
+	thread_pool_executor::item thread_pool_executor::steal(worker& self, priority prio) {
+		// xorshift, so that thieves don't all go after the same victim
+		self.seed ^= self.seed << 13;
+		self.seed ^= self.seed >> 7;
+		self.seed ^= self.seed << 17;
+
+		const std::size_t count = _workers.size();
+		const std::size_t start = self.seed % count;
+
+		for (std::size_t i = 0; i < count; ++i) {
+			worker& victim = *_workers[(start + i) % count];
+
+			if (&victim == &self)
+				continue;
+			auto& deque = victim.deques[static_cast<std::size_t>(prio)];
+
+			// the hint spares the fence in steal for the lanes that are empty most of the time
+			if (deque.empty())
+				continue;
+			if (item work = deque.steal()) {
+				self.steals.add();
+				return work;
+			}
+		}
+		return 0;
+	}
+
+	bool thread_pool_executor::has_stealable_item() const {
+		for (const inject_queue& queue : _inject) {
+			if (queue.size.load(std::memory_order_relaxed) > 0)
+				return true;
+		}
+
+		for (auto&& victim : _workers) {
+			for (const auto& deque : victim->deques) {
+				if (!deque.empty())
+					return true;
+			}
+		}
+		return false;
+	}
+
+	std::size_t thread_pool_executor::queue_depth(const worker& self) const {
+		std::size_t depth = self.lifo ? 1 : 0;
+
+		for (const auto& deque : self.deques)
+			depth += deque.size();
+		for (const inject_queue& queue : _inject)
+			depth += queue.size.load(std::memory_order_relaxed);
+		return depth;
+	}
+
+	executor_stats thread_pool_executor::stats() const {
+		executor_stats result;
+
+		for (auto&& self : _workers) {
+			result.tasks += self->tasks.get();
+			result.steals += self->steals.get();
+			result.wakeups += self->wakeups.get();
+			result.run_time += self->run_time.snapshot();
+			result.queue_depth += self->queue_depth.snapshot();
+		}
+
+		for (const inject_queue& queue : _inject)
+			result.injected += queue.pushed.get();
+		return result;
+	}
+
 	sequential_executor global_executor;
 } // namespace cobra
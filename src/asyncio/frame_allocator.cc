@@ -0,0 +1,106 @@
+#include "cobra/asyncio/frame_allocator.hh"
+
+#include <array>
+#include <new>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define COBRA_FRAME_POOL 0
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+#define COBRA_FRAME_POOL 0
+#endif
+#endif
+
+#ifndef COBRA_FRAME_POOL
+#define COBRA_FRAME_POOL 1
+#endif
+
+namespace cobra {
+	namespace {
+		constexpr std::size_t class_count = frame_allocator::max_size / frame_allocator::granularity;
+
+		struct free_frame {
+			free_frame* next;
+		};
+
+		struct free_list {
+			free_frame* head = nullptr;
+			std::size_t size = 0;
+		};
+
+		// trivially destructible so that it can still be looked at while the thread is being torn down
+		struct frame_cache {
+			std::array<free_list, class_count> lists;
+			std::size_t allocated;
+			bool destroyed;
+		};
+
+		thread_local frame_cache cache = {};
+
+		struct frame_cache_cleanup {
+			~frame_cache_cleanup() {
+				cache.destroyed = true;
+
+				for (free_list& list : cache.lists) {
+					while (free_frame* frame = list.head) {
+						list.head = frame->next;
+						::operator delete(frame);
+					}
+					list.size = 0;
+				}
+			}
+		};
+
+		thread_local frame_cache_cleanup cleanup;
+
+		// touching cleanup makes sure it gets constructed, and therefore destroyed, on this thread
+		inline frame_cache& local_cache() {
+			(void) &cleanup;
+			return cache;
+		}
+
+		inline std::size_t size_class(std::size_t size) {
+			return (size + frame_allocator::granularity - 1) / frame_allocator::granularity - 1;
+		}
+	} // namespace
+
+	void* frame_allocator::allocate(std::size_t size) {
+		frame_cache& local = local_cache();
+		local.allocated += 1;
+
+		if (!COBRA_FRAME_POOL || size > max_size || local.destroyed)
+			return ::operator new(size);
+
+		std::size_t index = size_class(size);
+		free_list& list = local.lists[index];
+
+		if (free_frame* frame = list.head) {
+			list.head = frame->next;
+			list.size -= 1;
+			return frame;
+		}
+		return ::operator new((index + 1) * granularity);
+	}
+
+	void frame_allocator::deallocate(void* ptr, std::size_t size) noexcept {
+		if (!COBRA_FRAME_POOL || size > max_size) {
+			::operator delete(ptr);
+			return;
+		}
+
+		frame_cache& local = local_cache();
+		free_list& list = local.lists[size_class(size)];
+
+		if (local.destroyed || list.size >= max_cached) {
+			::operator delete(ptr);
+			return;
+		}
+
+		list.head = new (ptr) free_frame{list.head};
+		list.size += 1;
+	}
+
+	std::size_t frame_allocator::allocated() noexcept {
+		return cache.allocated;
+	}
+} // namespace cobra
@@ -0,0 +1,369 @@
+#include "cobra/asyncio/io_uring_event_loop.hh"
+
+#include "cobra/exception.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <exception>
+
+extern "C" {
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+namespace cobra {
+	io_uring_event_loop::mapping::mapping(int fd, std::size_t size, off_t offset) : _size(size) {
+		_ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+
+		if (_ptr == MAP_FAILED)
+			throw errno_exception();
+	}
+
+	io_uring_event_loop::mapping::~mapping() {
+		munmap(_ptr, _size);
+	}
+
+	io_uring_event_loop::io_uring_event_loop(executor& exec, unsigned entries) : _ring_fd(-1), _exec(exec) {
+		io_uring_params params = {};
+
+		_ring_fd = file(check_return(syscall(__NR_io_uring_setup, entries, &params)));
+
+		std::size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		std::size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+
+		if (single_mmap)
+			sq_size = cq_size = std::max(sq_size, cq_size);
+
+		const mapping& sq = _sq_ring.emplace(_ring_fd.fd(), sq_size, IORING_OFF_SQ_RING);
+		const mapping& cq = single_mmap ? sq : _cq_ring.emplace(_ring_fd.fd(), cq_size, IORING_OFF_CQ_RING);
+		const mapping& sqes = _sqes_ring.emplace(_ring_fd.fd(), params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES);
+
+		_sq_head = sq.at<unsigned>(params.sq_off.head);
+		_sq_tail = sq.at<unsigned>(params.sq_off.tail);
+		_sq_mask = sq.at<unsigned>(params.sq_off.ring_mask);
+		_sq_array = sq.at<unsigned>(params.sq_off.array);
+		_sqes = sqes.at<io_uring_sqe>(0);
+		_timespecs.resize(params.sq_entries);
+
+		_cq_head = cq.at<unsigned>(params.cq_off.head);
+		_cq_tail = cq.at<unsigned>(params.cq_off.tail);
+		_cq_mask = cq.at<unsigned>(params.cq_off.ring_mask);
+		_cqes = cq.at<io_uring_cqe>(params.cq_off.cqes);
+
+		arm_wakeup();
+	}
+
+	void io_uring_event_loop::arm_wakeup() {
+		io_uring_sqe sqe = {};
+		sqe.opcode = IORING_OP_POLL_ADD;
+		sqe.fd = wakeup_fd().fd();
+		sqe.poll32_events = POLLIN;
+		push(sqe, wakeup_data, std::nullopt);
+	}
+
+	void io_uring_event_loop::operation::operator()(event_handle<int>& handle) {
+		if (_token.stop_requested()) {
+			handle.set_exception(std::make_exception_ptr(cancelled_exception()));
+			return;
+		}
+
+		const std::uint64_t user_data = reinterpret_cast<std::uintptr_t>(&handle);
+		_loop.get().push(_sqe, user_data, _timeout);
+
+		if (_token.stop_possible())
+			_cancel.arm(_token, operation_canceller{&_loop.get(), user_data});
+	}
+
+	void io_uring_event_loop::operation_canceller::operator()() const noexcept {
+		_loop->cancel(_user_data);
+	}
+
+	io_uring_event_loop::operation_type io_uring_event_loop::submit(const io_uring_sqe& sqe,
+																	std::optional<std::chrono::milliseconds> timeout,
+																	std::stop_token token) {
+		return operation{*this, sqe, timeout, std::move(token), {}};
+	}
+
+	void io_uring_event_loop::cancel_event(event_pair event, event_type::handle_type& handle) noexcept {
+		(void) event;
+		cancel(reinterpret_cast<std::uintptr_t>(&handle) | void_handle_tag);
+	}
+
+	void io_uring_event_loop::cancel(std::uint64_t user_data) noexcept {
+		io_uring_sqe sqe = {};
+		sqe.opcode = IORING_OP_ASYNC_CANCEL;
+		sqe.fd = -1;
+		sqe.addr = user_data;
+
+		try {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_cancelled.push_back(user_data);
+			}
+			push(sqe, (user_data & ~handle_tag_mask) | cancel_tag, std::nullopt);
+		} catch (...) {
+			// the operation just runs to completion then
+		}
+	}
+
+	bool io_uring_event_loop::take_cancelled(std::uint64_t user_data) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = std::find(_cancelled.begin(), _cancelled.end(), user_data);
+
+		if (it == _cancelled.end())
+			return false;
+		_cancelled.erase(it);
+		return true;
+	}
+
+	void io_uring_event_loop::schedule_event(event_pair event, std::optional<std::chrono::milliseconds> timeout,
+											 event_type::handle_type& handle) {
+		io_uring_sqe sqe = {};
+		sqe.opcode = IORING_OP_POLL_ADD;
+		sqe.fd = event.first;
+		sqe.poll32_events = event.second == poll_type::read ? POLLIN : POLLOUT;
+		push(sqe, reinterpret_cast<std::uintptr_t>(&handle) | void_handle_tag, timeout);
+	}
+
+	void io_uring_event_loop::schedule_sleep(clock::time_point deadline, loop_timer& timer,
+											 event_type::handle_type& handle) {
+		(void) timer;
+
+		auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch());
+		__kernel_timespec ts;
+		ts.tv_sec = since_epoch.count() / 1000000000;
+		ts.tv_nsec = since_epoch.count() % 1000000000;
+
+		// steady_clock is CLOCK_MONOTONIC, which is what absolute timeouts are measured against
+		io_uring_sqe sqe = {};
+		sqe.opcode = IORING_OP_TIMEOUT;
+		sqe.fd = -1;
+		sqe.len = 1;
+		sqe.timeout_flags = IORING_TIMEOUT_ABS;
+		push(sqe, reinterpret_cast<std::uintptr_t>(&handle) | sleep_handle_tag, std::nullopt, &ts);
+	}
+
+	void io_uring_event_loop::publish_sqe() {
+		unsigned tail = *_sq_tail;
+		unsigned index = tail & *_sq_mask;
+
+		_sq_array[index] = index;
+		std::atomic_ref<unsigned>(*_sq_tail).store(tail + 1, std::memory_order_release);
+		_pending += 1;
+	}
+
+	void io_uring_event_loop::push(const io_uring_sqe& sqe, std::uint64_t user_data,
+								   std::optional<std::chrono::milliseconds> timeout, const __kernel_timespec* timespec) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		const unsigned needed = timeout ? 2 : 1;
+		const unsigned capacity = *_sq_mask + 1;
+
+		// a linked pair must end up in the same submission, so make room for both before writing either
+		while (capacity - (*_sq_tail - std::atomic_ref<unsigned>(*_sq_head).load(std::memory_order_acquire)) < needed) {
+			_pending -= enter(_pending, 0, 0);
+		}
+
+		// sqes are written in place before the tail is published
+		unsigned tail = *_sq_tail;
+		io_uring_sqe* entry = &_sqes[tail & *_sq_mask];
+		*entry = sqe;
+		entry->user_data = user_data;
+
+		if (timespec) {
+			_timespecs[tail & *_sq_mask] = *timespec;
+			entry->addr = reinterpret_cast<std::uintptr_t>(&_timespecs[tail & *_sq_mask]);
+		}
+
+		if (timeout) {
+			entry->flags |= IOSQE_IO_LINK;
+
+			io_uring_sqe* link = &_sqes[(tail + 1) & *_sq_mask];
+			__kernel_timespec& ts = _timespecs[(tail + 1) & *_sq_mask];
+			ts.tv_sec = timeout->count() / 1000;
+			ts.tv_nsec = (timeout->count() % 1000) * 1000000;
+
+			*link = {};
+			link->opcode = IORING_OP_LINK_TIMEOUT;
+			link->fd = -1;
+			link->addr = reinterpret_cast<std::uintptr_t>(&ts);
+			link->len = 1;
+			link->user_data = 0;
+		}
+
+		for (unsigned i = 0; i < needed; i++)
+			publish_sqe();
+
+		// the loop thread submits everything at once when it polls, anybody else could be waiting for a very long
+		// time if the loop is blocked in io_uring_enter
+		if (std::this_thread::get_id() != _poll_thread)
+			_pending -= enter(_pending, 0, 0);
+	}
+
+	unsigned io_uring_event_loop::enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+		while (true) {
+			long rc = syscall(__NR_io_uring_enter, _ring_fd.fd(), to_submit, min_complete, flags, nullptr, 0);
+
+			if (rc >= 0)
+				return rc;
+			if (errno != EINTR)
+				throw errno_exception();
+		}
+	}
+
+	void io_uring_event_loop::complete(const io_uring_cqe& cqe) {
+		std::uint64_t user_data = cqe.user_data;
+		int res = cqe.res;
+
+		if (user_data == 0) {
+			// linked timeout, the operation it was linked to reports the outcome
+			return;
+		} else if (user_data == wakeup_data) {
+			// polls are one shot, rearmed after the eventfd was reset so that no post can slip in between
+			run_posted();
+			arm_wakeup();
+		} else if ((user_data & handle_tag_mask) == cancel_tag) {
+			// when the operation was found, its own -ECANCELED takes it off the list. Otherwise it already completed.
+			if (res != 0) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				std::erase_if(_cancelled, [user_data](std::uint64_t cancelled) {
+					return (cancelled & ~handle_tag_mask) == (user_data & ~handle_tag_mask);
+				});
+			}
+		} else if ((user_data & handle_tag_mask) == sleep_handle_tag) {
+			auto* handle = reinterpret_cast<event_handle<void>*>(user_data & ~handle_tag_mask);
+
+			// -ETIME is the timeout passing, which is all a sleep waits for
+			handle->set_value(_exec.get(), priority::io);
+		} else if ((user_data & handle_tag_mask) == void_handle_tag) {
+			auto* handle = reinterpret_cast<event_handle<void>*>(user_data & ~handle_tag_mask);
+
+			if (res >= 0) {
+				handle->set_value(_exec.get(), priority::io);
+			} else if (res == -ECANCELED && take_cancelled(user_data)) {
+				handle->set_exception(std::make_exception_ptr(cancelled_exception()), _exec.get(), priority::io);
+			} else if (res == -ECANCELED) {
+				handle->set_exception(std::make_exception_ptr(timeout_exception()), _exec.get(), priority::io);
+			} else {
+				handle->set_exception(std::make_exception_ptr(errno_exception(-res)), _exec.get(), priority::io);
+			}
+		} else {
+			auto* handle = reinterpret_cast<event_handle<int>*>(user_data);
+
+			if (res == -ECANCELED && take_cancelled(user_data))
+				handle->set_exception(std::make_exception_ptr(cancelled_exception()), _exec.get(), priority::io);
+			else
+				handle->set_value(res, _exec.get(), priority::io);
+		}
+	}
+
+	void io_uring_event_loop::poll() {
+		unsigned to_submit;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_poll_thread = std::this_thread::get_id();
+			to_submit = std::exchange(_pending, 0);
+		}
+
+		unsigned submitted = enter(to_submit, 1, IORING_ENTER_GETEVENTS);
+
+		if (submitted < to_submit) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			_pending += to_submit - submitted;
+		}
+
+		unsigned head = *_cq_head;
+		unsigned tail = std::atomic_ref<unsigned>(*_cq_tail).load(std::memory_order_acquire);
+
+		while (head != tail) {
+			io_uring_cqe cqe = _cqes[head & *_cq_mask];
+			std::atomic_ref<unsigned>(*_cq_head).store(++head, std::memory_order_release);
+			complete(cqe);
+		}
+	}
+
+	std::size_t io_uring_event_loop::check_result(int res) {
+		if (res == -ECANCELED) {
+			throw timeout_exception();
+		} else if (res < 0) {
+			throw errno_exception(-res);
+		}
+		return res;
+	}
+
+	task<std::size_t> io_uring_event_loop::recv(const file& fd, char* data, std::size_t size,
+												std::stop_token token) {
+		io_uring_sqe sqe = {};
+		sqe.opcode = IORING_OP_RECV;
+		sqe.fd = fd.fd();
+		sqe.addr = reinterpret_cast<std::uintptr_t>(data);
+		sqe.len = std::min<std::size_t>(size, UINT_MAX);
+
+		while (true) {
+			int res = co_await submit(sqe, std::nullopt, token);
+
+			// older kernels without fast poll hand nonblocking sockets straight back
+			if (res != -EAGAIN)
+				co_return check_result(res);
+			co_await wait_read(fd, std::nullopt, token);
+		}
+	}
+
+	task<std::size_t> io_uring_event_loop::send(const file& fd, const char* data, std::size_t size,
+												std::stop_token token) {
+		io_uring_sqe sqe = {};
+		sqe.opcode = IORING_OP_SEND;
+		sqe.fd = fd.fd();
+		sqe.addr = reinterpret_cast<std::uintptr_t>(data);
+		sqe.len = std::min<std::size_t>(size, UINT_MAX);
+		sqe.msg_flags = MSG_NOSIGNAL;
+
+		while (true) {
+			int res = co_await submit(sqe, std::nullopt, token);
+
+			if (res != -EAGAIN)
+				co_return check_result(res);
+			co_await wait_write(fd, std::nullopt, token);
+		}
+	}
+
+	task<file> io_uring_event_loop::accept(const file& fd) {
+		io_uring_sqe sqe = {};
+		sqe.opcode = IORING_OP_ACCEPT;
+		sqe.fd = fd.fd();
+		sqe.accept_flags = SOCK_NONBLOCK;
+
+		while (true) {
+			int res = co_await submit(sqe);
+
+			if (res != -EAGAIN)
+				co_return file(check_result(res));
+			co_await wait_read(fd);
+		}
+	}
+
+	task<bool> io_uring_event_loop::connect(const file& fd, const sockaddr* addr, socklen_t len) {
+		io_uring_sqe sqe = {};
+		sqe.opcode = IORING_OP_CONNECT;
+		sqe.fd = fd.fd();
+		sqe.addr = reinterpret_cast<std::uintptr_t>(addr);
+		sqe.off = len;
+
+		int res = co_await submit(sqe);
+
+		if (res == -EINPROGRESS || res == -EAGAIN) {
+			co_await wait_write(fd);
+
+			int error;
+			socklen_t error_len = sizeof error;
+			check_return(getsockopt(fd.fd(), SOL_SOCKET, SO_ERROR, &error, &error_len));
+			co_return error == 0;
+		}
+		co_return res == 0;
+	}
+} // namespace cobra
@@ -1,25 +1,42 @@
 #include "cobra/asyncio/mutex.hh"
 #include "cobra/asyncio/task.hh"
 
+#include <cassert>
+#include <thread>
+
 namespace cobra {
 	void async_mutex::lock_event::operator()(event_handle<void>& handle) {
-		bool locked;
-
-		{
-			std::lock_guard lock(_mutex->_mutex);
-			locked = std::exchange(_mutex->_locked, true);
+		std::uintptr_t state = _mutex->_state.load(std::memory_order_relaxed);
+		unsigned spin = _mutex->_spin;
+
+		_handle = &handle;
+
+		while (true) {
+			if (state == not_locked) {
+				if (_mutex->_state.compare_exchange_weak(state, locked_no_waiters, std::memory_order_acquire,
+														 std::memory_order_relaxed)) {
+					handle.set_value();
+					return;
+				}
+			} else if (spin > 0) {
+				spin -= 1;
+				std::this_thread::yield();
+				state = _mutex->_state.load(std::memory_order_relaxed);
+			} else {
+				_next = state == locked_no_waiters ? nullptr : reinterpret_cast<lock_event*>(state);
 
-			if (locked) {
-				_mutex->_queue.push(&handle);
+				if (_mutex->_state.compare_exchange_weak(state, reinterpret_cast<std::uintptr_t>(this),
+														 std::memory_order_release, std::memory_order_relaxed))
+					return;
 			}
 		}
+	}
 
-		if (!locked) {
-			handle.set_value();
-		}
+	async_mutex::async_mutex(executor* exec, handoff mode, unsigned spin) : _exec(exec), _handoff(mode), _spin(spin) {
 	}
 
-	async_mutex::async_mutex(executor* exec) : _exec(exec) {
+	async_mutex::~async_mutex() {
+		assert(_state.load(std::memory_order_relaxed) == not_locked && "async_mutex destroyed while locked");
 	}
 
 	event<void, async_mutex::lock_event> async_mutex::lock() {
@@ -27,29 +44,37 @@ namespace cobra {
 	}
 
 	bool async_mutex::try_lock() {
-		std::lock_guard lock(_mutex);
-		return !std::exchange(_locked, true);
+		std::uintptr_t state = not_locked;
+		return _state.compare_exchange_strong(state, locked_no_waiters, std::memory_order_acquire,
+											  std::memory_order_relaxed);
 	}
 
 	void async_mutex::unlock() {
-		event_handle<void>* next = nullptr;
+		lock_event* next = _waiters;
 
-		{
-			std::lock_guard lock(_mutex);
+		if (!next) {
+			std::uintptr_t state = locked_no_waiters;
 
-			if (_queue.empty()) {
-				_locked = false;
-			} else {
-				next = _queue.front();
-				_queue.pop();
+			if (_state.compare_exchange_strong(state, not_locked, std::memory_order_release, std::memory_order_relaxed))
+				return;
+
+			// takes the queued waiters and leaves the mutex locked for the first of them
+			state = _state.exchange(locked_no_waiters, std::memory_order_acquire);
+
+			for (lock_event* waiter = reinterpret_cast<lock_event*>(state); waiter;) {
+				lock_event* older = waiter->_next;
+				waiter->_next = next;
+				next = waiter;
+				waiter = older;
 			}
 		}
 
-		if (next) {
-			_exec->schedule([next]() {
-				next->set_value();
-			});
-		}
+		_waiters = next->_next;
+
+		if (_handoff == handoff::direct)
+			next->_handle->set_value();
+		else
+			next->_handle->set_value(*_exec);
 	}
 
 	async_lock::async_lock(async_mutex& mutex) : _mutex(&mutex) {
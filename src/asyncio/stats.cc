@@ -0,0 +1,65 @@
+#include "cobra/asyncio/stats.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace cobra {
+	histogram_snapshot& histogram_snapshot::operator+=(const histogram_snapshot& other) noexcept {
+		for (std::size_t i = 0; i < bucket_count; ++i)
+			buckets[i] += other.buckets[i];
+		count += other.count;
+		sum += other.sum;
+		max = std::max(max, other.max);
+		return *this;
+	}
+
+	double histogram_snapshot::mean() const noexcept {
+		return count == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(count);
+	}
+
+	std::uint64_t histogram_snapshot::quantile(double q) const noexcept {
+		if (count == 0)
+			return 0;
+
+		const std::uint64_t rank =
+			std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(count))));
+		std::uint64_t seen = 0;
+
+		for (std::size_t i = 0; i < bucket_count; ++i) {
+			seen += buckets[i];
+
+			if (seen >= rank) {
+				if (i == 0)
+					return 0;
+				// the last bucket has no upper bound of its own
+				if (i + 1 == bucket_count)
+					return max;
+				return std::min(max, (std::uint64_t(1) << i) - 1);
+			}
+		}
+		return max;
+	}
+
+	void stat_histogram::record(std::uint64_t value) noexcept {
+		const std::size_t bucket = std::min<std::size_t>(std::bit_width(value), histogram_snapshot::bucket_count - 1);
+
+		_buckets[bucket].add();
+		_count.add();
+		_sum.add(value);
+
+		if (value > _max.load(std::memory_order_relaxed))
+			_max.store(value, std::memory_order_relaxed);
+	}
+
+	histogram_snapshot stat_histogram::snapshot() const noexcept {
+		histogram_snapshot result;
+
+		for (std::size_t i = 0; i < histogram_snapshot::bucket_count; ++i)
+			result.buckets[i] = _buckets[i].get();
+		result.count = _count.get();
+		result.sum = _sum.get();
+		result.max = _max.load(std::memory_order_relaxed);
+		return result;
+	}
+} // namespace cobra
@@ -0,0 +1,162 @@
+#include "cobra/asyncio/timer.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <utility>
+
+namespace cobra {
+	timer_node::timer_node(const timer_node& other) noexcept {
+		(void) other;
+	}
+
+	timer_node& timer_node::operator=(const timer_node& other) noexcept {
+		(void) other;
+		return *this;
+	}
+
+	void timer_wheel::list::push_back(timer_node& node) noexcept {
+		node._prev = tail;
+		node._next = nullptr;
+
+		if (tail)
+			tail->_next = &node;
+		else
+			head = &node;
+		tail = &node;
+	}
+
+	void timer_wheel::list::erase(timer_node& node) noexcept {
+		if (node._prev)
+			node._prev->_next = node._next;
+		else
+			head = node._next;
+
+		if (node._next)
+			node._next->_prev = node._prev;
+		else
+			tail = node._prev;
+
+		node._prev = node._next = nullptr;
+	}
+
+	timer_wheel::timer_wheel(time_point start) : _start(start) {}
+
+	std::uint64_t timer_wheel::to_tick(time_point point, bool round_up) const noexcept {
+		if (point <= _start)
+			return 0;
+
+		auto since = point - _start;
+		auto ticks = round_up ? std::chrono::ceil<std::chrono::milliseconds>(since)
+							  : std::chrono::floor<std::chrono::milliseconds>(since);
+		return ticks.count();
+	}
+
+	void timer_wheel::insert(timer_node& node, time_point deadline) noexcept {
+		assert(!node._armed && "timer is already armed");
+
+		// rounded up so that a timer never fires early
+		node._deadline = to_tick(deadline, true);
+		link(node);
+		_size += 1;
+	}
+
+	void timer_wheel::link(timer_node& node) noexcept {
+		node._armed = true;
+
+		if (node._deadline <= _elapsed) {
+			node._level = expired_level;
+			_expired.push_back(node);
+			return;
+		}
+
+		// the highest bit in which the deadline differs from now decides the level
+		std::uint64_t masked = (_elapsed ^ node._deadline) | (slot_count - 1);
+		unsigned significant = std::min<unsigned>(std::bit_width(masked) - 1, slot_bits * level_count - 1);
+
+		node._level = significant / slot_bits;
+		node._slot = (node._deadline >> (node._level * slot_bits)) % slot_count;
+
+		level& lvl = _levels[node._level];
+		lvl.slots[node._slot].push_back(node);
+		lvl.occupied |= std::uint64_t(1) << node._slot;
+	}
+
+	void timer_wheel::cancel(timer_node& node) noexcept {
+		if (!node._armed)
+			return;
+
+		if (node._level == expired_level) {
+			_expired.erase(node);
+		} else {
+			level& lvl = _levels[node._level];
+			lvl.slots[node._slot].erase(node);
+
+			if (lvl.slots[node._slot].empty())
+				lvl.occupied &= ~(std::uint64_t(1) << node._slot);
+		}
+
+		node._armed = false;
+		_size -= 1;
+	}
+
+	std::optional<timer_wheel::expiration> timer_wheel::next_expiration() const noexcept {
+		// a timer on a level always expires after every timer on the levels below it
+		for (unsigned index = 0; index < level_count; ++index) {
+			const level& lvl = _levels[index];
+
+			if (lvl.occupied == 0)
+				continue;
+
+			const std::uint64_t slot_range = std::uint64_t(1) << (index * slot_bits);
+			const std::uint64_t level_range = slot_range << slot_bits;
+			const unsigned now_slot = (_elapsed >> (index * slot_bits)) % slot_count;
+			const unsigned slot = (std::countr_zero(std::rotr(lvl.occupied, now_slot)) + now_slot) % slot_count;
+
+			std::uint64_t deadline = (_elapsed & ~(level_range - 1)) + slot * slot_range;
+			if (deadline <= _elapsed)
+				deadline += level_range;
+			return expiration{index, slot, deadline};
+		}
+		return std::nullopt;
+	}
+
+	timer_node* timer_wheel::pop_expired(time_point now) noexcept {
+		const std::uint64_t target = to_tick(now, false);
+
+		while (_expired.empty()) {
+			std::optional<expiration> next = next_expiration();
+
+			if (!next || next->deadline > target) {
+				_elapsed = std::max(_elapsed, target);
+				return nullptr;
+			}
+
+			// timers in the slot either expired or get pushed down to a lower level
+			_elapsed = next->deadline;
+			level& lvl = _levels[next->level];
+			list slot = std::exchange(lvl.slots[next->slot], list());
+			lvl.occupied &= ~(std::uint64_t(1) << next->slot);
+
+			while (timer_node* node = slot.head) {
+				slot.erase(*node);
+				link(*node);
+			}
+		}
+
+		timer_node* node = _expired.head;
+		_expired.erase(*node);
+		node->_armed = false;
+		_size -= 1;
+		return node;
+	}
+
+	std::optional<timer_wheel::time_point> timer_wheel::next_deadline() const noexcept {
+		if (!_expired.empty())
+			return _start + std::chrono::milliseconds(_elapsed);
+
+		if (std::optional<expiration> next = next_expiration())
+			return _start + std::chrono::milliseconds(next->deadline);
+		return std::nullopt;
+	}
+} // namespace cobra
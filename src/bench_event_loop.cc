@@ -0,0 +1,88 @@
+#include "cobra/asyncio/event_loop.hh"
+#include "cobra/asyncio/future_task.hh"
+#include "cobra/print.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+extern "C" {
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#ifdef COBRA_BENCH_EVENT_LOOP
+
+// Measures how many readiness events epoll_event_loop dispatches per second. Every socket pair has a coroutine
+// waiting on one end, each round writes a byte to all of them and polls until every coroutine woke up.
+// usage: webserv [pairs] [rounds]
+
+static cobra::task<void> drain(cobra::event_loop& loop, const cobra::file& fd, std::size_t& woken, std::size_t& done) {
+	char buffer[64];
+
+	while (true) {
+		if (auto nread = cobra::check_would_block(::read(fd.fd(), buffer, sizeof buffer))) {
+			if (*nread == 0) {
+				done += 1;
+				co_return;
+			}
+			woken += 1;
+			continue;
+		}
+		co_await loop.wait_read(fd);
+	}
+}
+
+int main(int argc, char **argv) {
+	using namespace cobra;
+	using clock = std::chrono::steady_clock;
+
+	const std::size_t pairs = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+	const std::size_t rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+
+	sequential_executor exec;
+	epoll_event_loop loop(exec);
+	std::vector<file> readers;
+	std::vector<file> writers;
+	std::vector<future_task<void>> tasks;
+	std::size_t woken = 0;
+	std::size_t done = 0;
+
+	readers.reserve(pairs);
+	writers.reserve(pairs);
+	tasks.reserve(pairs);
+
+	for (std::size_t i = 0; i < pairs; ++i) {
+		int fds[2];
+		check_return(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+		readers.emplace_back(fds[0]);
+		writers.emplace_back(fds[1]);
+	}
+
+	for (const file& reader : readers)
+		tasks.push_back(make_future_task(drain(loop, reader, woken, done)));
+
+	clock::duration polling = clock::duration::zero();
+
+	for (std::size_t round = 0; round < rounds; ++round) {
+		for (const file& writer : writers)
+			check_return(::write(writer.fd(), "x", 1));
+
+		auto start = clock::now();
+		while (woken < pairs * (round + 1))
+			loop.poll();
+		polling += clock::now() - start;
+	}
+
+	// closing the writers lets every coroutine return before its frame is destroyed
+	writers.clear();
+	while (done < pairs)
+		loop.poll();
+
+	double seconds = std::chrono::duration<double>(polling).count();
+	println("{} events in {:.3f}s, {:.0f} events/s, {:.1f} events per wait", woken, seconds, woken / seconds,
+			loop.stats().events_per_wait());
+	return EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "cobra/asyncio/future_task.hh"
+#include "cobra/asyncio/std_stream.hh"
+#include "cobra/asyncio/stream_buffer.hh"
+#include "cobra/http/arena.hh"
+#include "cobra/http/parse.hh"
+#include "cobra/print.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#ifdef COBRA_BENCH_PARSE
+
+// Measures how many requests per second parse_http_request gets through and how often it goes to the heap. Every
+// round parses a batch of copies of a typical browser request back to back out of one in-memory stream, the way
+// pipelined requests arrive, each one into the same arena like a connection does.
+// usage: webserv [batch] [rounds]
+
+static std::size_t allocations = 0;
+
+void* operator new(std::size_t size) {
+	allocations += 1;
+
+	if (void* ptr = std::malloc(size))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+static constexpr std::string_view sample_request =
+	"GET /static/images/logo.png?v=3 HTTP/1.1\r\n"
+	"Host: www.example.com\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/118.0\r\n"
+	"Accept: image/avif,image/webp,*/*\r\n"
+	"Accept-Language: en-US,en;q=0.5\r\n"
+	"Accept-Encoding: gzip, deflate, br\r\n"
+	"Referer: https://www.example.com/index.html\r\n"
+	"Connection: keep-alive\r\n"
+	"Cookie: session=7f3a9c2e1b; theme=dark\r\n"
+	"Sec-Fetch-Dest: image\r\n"
+	"Sec-Fetch-Mode: no-cors\r\n"
+	"Sec-Fetch-Site: same-origin\r\n"
+	"\r\n";
+
+static cobra::task<std::size_t> parse_batch(std::string input, std::size_t batch) {
+	using namespace cobra;
+
+	istream_buffer stream(std_istream<std::stringstream>(std::stringstream(std::move(input))), 1024);
+	request_arena arena;
+	std::size_t headers = 0;
+
+	for (std::size_t i = 0; i < batch; ++i) {
+		{
+			http_request request = co_await parse_http_request(stream, arena.resource());
+			headers += request.header_map().size();
+		}
+		arena.release();
+	}
+	co_return headers;
+}
+
+int main(int argc, char **argv) {
+	using namespace cobra;
+	using clock = std::chrono::steady_clock;
+
+	const std::size_t batch = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+	const std::size_t rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200;
+
+	std::string input;
+	std::size_t headers = 0;
+	std::size_t allocated = 0;
+	clock::duration parsing = clock::duration::zero();
+
+	for (std::size_t i = 0; i < batch; ++i)
+		input += sample_request;
+
+	for (std::size_t round = 0; round < rounds; ++round) {
+		std::string copy = input;
+		auto start = clock::now();
+		const std::size_t before = allocations;
+
+		headers += block_task(parse_batch(std::move(copy), batch));
+		allocated += allocations - before;
+		parsing += clock::now() - start;
+	}
+
+	const std::size_t requests = batch * rounds;
+	double seconds = std::chrono::duration<double>(parsing).count();
+	println("{} requests ({} headers) in {:.3f}s, {:.0f} requests/s, {:.1f} MB/s, {:.2f} allocations per request",
+			requests, headers, seconds, requests / seconds, requests * sample_request.size() / seconds / 1e6,
+			static_cast<double>(allocated) / requests);
+	return EXIT_SUCCESS;
+}
+
+#endif
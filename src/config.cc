@@ -1,4 +1,5 @@
 #include "cobra/config.hh"
+#include "cobra/affinity.hh"
 
 #include "cobra/exception.hh"
 #include "cobra/net/address.hh"
@@ -45,6 +46,12 @@ namespace cobra {
 #undef X
 		};
 
+		const static std::vector<std::string> GLOBAL_KEYWORDS = {
+#define X(keyword) #keyword,
+			COBRA_GLOBAL_KEYWORDS
+#undef X
+		};
+
 		std::size_t levenshtein_dist(const std::string& a, const std::string& b) {
 			if (a.length() == 0) {
 				return b.length();
@@ -740,6 +747,11 @@ namespace cobra {
 		}
 
 		std::vector<server_config> server_config::parse_servers(parse_session& session) {
+			return std::move(global_config::parse(session).servers());
+		}
+
+		global_config global_config::parse(parse_session& session) {
+			global_config config;
 			std::vector<define<server_config>> configs;
 
 			while (true) {
@@ -748,19 +760,137 @@ namespace cobra {
 				if (session.eof())
 					break;
 
-				session.expect_word_simple("server", "keyword");
+				const word w = session.get_word_simple("keyword");
 
-				configs.push_back(server_config::parse(session));
+				if (w.str() == "server") {
+					configs.push_back(server_config::parse(session));
+				} else if (w.str() == "threads") {
+					config.parse_threads(session);
+				} else if (w.str() == "cpus") {
+					config.parse_cpus(session);
+				} else if (w.str() == "max_events") {
+					config.parse_max_events(session);
+				} else {
+					throw error(diagnostic::error(w.part(), std::format("unknown directive `{}`", w.str()),
+												  std::format("did you mean `{}`?", get_suggestion(GLOBAL_KEYWORDS, w.str()))));
+				}
 			}
 
 			server_config::lint_configs(configs, session);
 
-			std::vector<server_config> result;
-			result.reserve(configs.size());
+			config._servers.reserve(configs.size());
 			for (auto&& cfg : configs) {
-				result.push_back(std::move(cfg));
+				config._servers.push_back(std::move(cfg));
+			}
+			return config;
+		}
+
+		void global_config::parse_threads(parse_session& session) {
+			const std::size_t define_start = session.column() - std::string("threads").length();
+			session.ignore_ws();
+
+			const std::size_t col = session.column();
+			const std::size_t line = session.line();
+
+			std::string word;
+			try {
+				word = session.get_word_simple("number", "threads");
+			} catch (error err) {
+				err.diag().message = "invalid number";
+				throw err;
+			}
+
+			try {
+				const std::size_t len = col + word.length() - define_start;
+				const std::size_t threads = parse_unsigned<std::size_t>(word, max_threads);
+
+				if (threads == 0)
+					throw error(diagnostic::error(file_part(0, word.length()), "not enough threads",
+												  "at least one thread is needed"));
+
+				if (_threads) {
+					diagnostic diag = session.make_warn(line, define_start, len, "redefinition of threads");
+					diag.sub_diags.push_back(diagnostic::note(_threads->part, "previously defined here"));
+					session.report(diag);
+				}
+
+				_threads = define<std::size_t>(threads, file_part(session.file(), line, define_start, len));
+			} catch (error err) {
+				err.diag().message = "invalid threads";
+				err.diag().part = file_part(session.file(), line, col, word.length());
+				throw err;
+			}
+		}
+
+		void global_config::parse_cpus(parse_session& session) {
+			const std::size_t define_start = session.column() - std::string("cpus").length();
+			session.ignore_ws();
+
+			const std::size_t col = session.column();
+			const std::size_t line = session.line();
+
+			std::string word;
+			try {
+				word = session.get_word_simple("cpu list", "cpus");
+			} catch (error err) {
+				err.diag().message = "invalid cpu list";
+				throw err;
+			}
+
+			const std::size_t len = col + word.length() - define_start;
+			std::vector<unsigned> cpus;
+
+			try {
+				cpus = parse_cpu_list(word);
+			} catch (const std::invalid_argument& ex) {
+				throw error(diagnostic::error(file_part(session.file(), line, col, word.length()), "invalid cpus",
+											  ex.what()));
+			}
+
+			if (_cpus) {
+				diagnostic diag = session.make_warn(line, define_start, len, "redefinition of cpus");
+				diag.sub_diags.push_back(diagnostic::note(_cpus->part, "previously defined here"));
+				session.report(diag);
+			}
+
+			_cpus = define<std::vector<unsigned>>(std::move(cpus), file_part(session.file(), line, define_start, len));
+		}
+
+		void global_config::parse_max_events(parse_session& session) {
+			const std::size_t define_start = session.column() - std::string("max_events").length();
+			session.ignore_ws();
+
+			const std::size_t col = session.column();
+			const std::size_t line = session.line();
+
+			std::string word;
+			try {
+				word = session.get_word_simple("number", "max_events");
+			} catch (error err) {
+				err.diag().message = "invalid number";
+				throw err;
+			}
+
+			try {
+				const std::size_t len = col + word.length() - define_start;
+				const std::size_t max_events = parse_unsigned<std::size_t>(word, max_max_events);
+
+				if (max_events == 0)
+					throw error(diagnostic::error(file_part(0, word.length()), "not enough events",
+												  "at least one event is needed"));
+
+				if (_max_events) {
+					diagnostic diag = session.make_warn(line, define_start, len, "redefinition of max_events");
+					diag.sub_diags.push_back(diagnostic::note(_max_events->part, "previously defined here"));
+					session.report(diag);
+				}
+
+				_max_events = define<std::size_t>(max_events, file_part(session.file(), line, define_start, len));
+			} catch (error err) {
+				err.diag().message = "invalid max_events";
+				err.diag().part = file_part(session.file(), line, col, word.length());
+				throw err;
 			}
-			return result;
 		}
 
 		void server_config::lint_configs(const std::vector<define<server_config>>& configs,
@@ -1142,6 +1272,50 @@ namespace cobra {
 			_ssl = parse_define<ssl_config>(session, "ssl");
 		}
 
+		// single number directive, warns when it replaces a previous definition
+		static void parse_count(parse_session& session, const std::string& directive,
+								std::optional<define<std::size_t>>& result,
+								std::size_t max_value = std::numeric_limits<std::size_t>::max()) {
+			const std::size_t define_start = session.column() - directive.length();
+			session.ignore_ws();
+
+			const std::size_t col = session.column();
+			const std::size_t line = session.line();
+
+			std::string word;
+			try {
+				word = session.get_word_simple("number", directive);
+			} catch (error err) {
+				err.diag().message = "invalid number";
+				throw err;
+			}
+
+			try {
+				const std::size_t len = col + word.length() - define_start;
+				const std::size_t count = parse_unsigned<std::size_t>(word, max_value);
+
+				if (result) {
+					diagnostic diag = session.make_warn(line, define_start, len, std::format("redefinition of {}", directive));
+					diag.sub_diags.push_back(diagnostic::note(result->part, "previously defined here"));
+					session.report(diag);
+				}
+
+				result = define<std::size_t>(count, file_part(session.file(), line, define_start, len));
+			} catch (error err) {
+				err.diag().message = std::format("invalid {}", directive);
+				err.diag().part = file_part(session.file(), line, col, word.length());
+				throw err;
+			}
+		}
+
+		void server_config::parse_keepalive_timeout(parse_session& session) {
+			parse_count(session, "keepalive_timeout", _keepalive_timeout, max_keepalive_timeout);
+		}
+
+		void server_config::parse_keepalive_requests(parse_session& session) {
+			parse_count(session, "keepalive_requests", _keepalive_requests);
+		}
+
 		config::config(config* parent, const block_config& cfg)
 			: parent(parent), max_body_size(cfg._max_body_size), handler(cfg._handler) {
 			if (cfg._index)
@@ -1228,6 +1402,11 @@ namespace cobra {
 			for (auto& address : cfg._addresses) {
 				addresses.push_back(address);
 			}
+
+			if (cfg._keepalive_timeout)
+				keepalive_timeout = cfg._keepalive_timeout->def;
+			if (cfg._keepalive_requests)
+				keepalive_requests = cfg._keepalive_requests->def;
 		}
 
 		void server::debug_print(std::ostream& stream, std::size_t depth) const {
@@ -1244,6 +1423,10 @@ namespace cobra {
 				println(stream, "{}cert: \"{}\"", spacing, ssl->cert().string());
 				println(stream, "{}key: \"{}\"", spacing, ssl->key().string());
 			}
+			if (keepalive_timeout)
+				println(stream, "{}keepalive_timeout: {}", spacing, *keepalive_timeout);
+			if (keepalive_requests)
+				println(stream, "{}keepalive_requests: {}", spacing, *keepalive_requests);
 			config::debug_print(stream, depth);
 		}
 	} // namespace config
@@ -10,6 +10,7 @@ namespace cobra {
 	errno_exception::errno_exception() : errno_exception(errno) {}
 	errno_exception::errno_exception(int errc) : std::runtime_error(std::strerror(errc)), _errc(errc) {}
 	timeout_exception::timeout_exception() : std::runtime_error("something timed out") {}
+	cancelled_exception::cancelled_exception() : std::runtime_error("operation was cancelled") {}
 	parse_error::parse_error(const std::string& what) : std::runtime_error(what) {}
 	parse_error::parse_error(const char* what) : std::runtime_error(what) {}
 } // namespace cobra
@@ -2,15 +2,15 @@
 #include "cobra/serde.hh"
 
 namespace cobra {
-	fastcgi_client_connection::fastcgi_client_connection(istream_reference istream, ostream_reference ostream) : _istream(istream), _ostream(ostream) {
+	fastcgi_client_connection::fastcgi_client_connection(istream_reference istream, ostream_reference ostream, std::stop_token token) : _mutex(&global_executor, async_mutex::handoff::direct), _token(std::move(token)), _istream(istream), _ostream(ostream) {
 	}
 
 	async_mutex& fastcgi_client_connection::mutex() {
 		return _mutex;
 	}
 
-	async_condition_variable& fastcgi_client_connection::condition_variable() {
-		return _condition_variable;
+	const std::stop_token& fastcgi_client_connection::stop_token() const {
+		return _token;
 	}
 	
 	task<std::shared_ptr<fastcgi_client>> fastcgi_client_connection::get_client(std::uint16_t request_id) {
@@ -90,8 +90,8 @@ namespace cobra {
 			co_await read_u8(_istream);
 			co_await read_u8(_istream);
 			co_await read_u16_be(_istream);
-			co_await client->fcgi_stdout().close();
-			co_await client->fcgi_stderr().close();
+			client->fcgi_stdout().close();
+			client->fcgi_stderr().close();
 			async_lock lock = co_await async_lock::lock(_mutex);
 			_clients.erase(request_id);
 		} else if (type == static_cast<std::uint8_t>(fastcgi_record_type::fcgi_stdout)) {
@@ -99,13 +99,13 @@ namespace cobra {
 			buffer.resize(content_length);
 			co_await _istream.read_all(buffer.data(), content_length);
 			std::shared_ptr<fastcgi_client> client = co_await get_client(request_id);
-			co_await client->fcgi_stdout().write(buffer.data(), content_length);
+			co_await client->fcgi_stdout().write(std::move(buffer));
 		} else if (type == static_cast<std::uint8_t>(fastcgi_record_type::fcgi_stderr)) {
 			std::vector<char> buffer;
 			buffer.resize(content_length);
 			co_await _istream.read_all(buffer.data(), content_length);
 			std::shared_ptr<fastcgi_client> client = co_await get_client(request_id);
-			co_await client->fcgi_stderr().write(buffer.data(), content_length);
+			co_await client->fcgi_stderr().write(std::move(buffer));
 		} else {
 			std::vector<char> buffer;
 			buffer.resize(content_length);
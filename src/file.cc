@@ -7,12 +7,18 @@
 #include <utility>
 
 namespace cobra {
+	file_observer::~file_observer() {}
+
 	file::file(int fd) noexcept : _fd(fd) {}
 
-	file::file(file&& other) noexcept : _fd(std::exchange(other._fd, -1)) {}
+	file::file(file&& other) noexcept
+		: _fd(std::exchange(other._fd, -1)), _observer(std::exchange(other._observer, nullptr)) {}
 
 	file::~file() {
 		if (_fd != -1) {
+			if (_observer)
+				_observer->file_closed(_fd);
+
 			int rc = ::close(_fd);
 
 			if (rc == -1)
@@ -22,9 +28,14 @@ namespace cobra {
 
 	file& file::operator=(file other) noexcept {
 		std::swap(_fd, other._fd);
+		std::swap(_observer, other._observer);
 		return *this;
 	}
 
+	void file::set_observer(file_observer* observer) const noexcept {
+		_observer = observer;
+	}
+
 	void file::close() {
 		*this = file(-1);
 	}
@@ -36,4 +47,10 @@ namespace cobra {
 			return ret;
 		}
 	}
+
+	std::optional<std::size_t> check_would_block(ssize_t ret) {
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return std::nullopt;
+		return check_return(ret);
+	}
 } // namespace cobra
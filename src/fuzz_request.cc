@@ -1,9 +1,16 @@
+#include <algorithm>
 #include <cstdint>
+#include <cstdlib>
+#include <format>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include "cobra/http/message.hh"
 #include "cobra/http/parse.hh"
+#include "cobra/http/util.hh"
 #include "cobra/asyncio/future_task.hh"
 #include "cobra/asyncio/std_stream.hh"
 #include "cobra/asyncio/stream_buffer.hh"
@@ -11,17 +18,231 @@
 
 #ifdef COBRA_FUZZ_REQUEST
 
+namespace {
+	using namespace cobra;
+
+	// The request parser as it was before it learned to parse whole fill_buf windows: one byte at a time, in the
+	// same order and with the same limits. Kept apart from src/http/parse.cc so that it stays the reference. The
+	// only intended difference is that it throws unexpected_eof where a version digit is missing, the old parser
+	// dereferenced an empty optional there.
+	class reference_parser {
+		std::string_view _input;
+		std::size_t _pos = 0;
+
+		static void expect(bool condition, http_parse_error error) {
+			if (!condition)
+				throw error;
+		}
+
+		char peek() const {
+			expect(_pos != _input.size(), http_parse_error::unexpected_eof);
+			return _input[_pos];
+		}
+
+		char get() {
+			const char ch = peek();
+			++_pos;
+			return ch;
+		}
+
+		template <std::predicate<char> UnaryPredicate>
+		bool take(UnaryPredicate pred) {
+			if (!pred(peek()))
+				return false;
+			++_pos;
+			return true;
+		}
+
+		bool take(char ch) {
+			return take([ch](char other) { return other == ch; });
+		}
+
+		bool take(std::string_view str) {
+			for (char ch : str) {
+				if (!take(ch))
+					return false;
+			}
+			return true;
+		}
+
+		bool parse_eol() {
+			const bool cr = take('\r');
+			expect(take('\n') == cr, http_parse_error::bad_eol);
+			return cr;
+		}
+
+		template <std::predicate<char> UnaryPredicate>
+		std::string parse_string(UnaryPredicate pred, std::size_t max_length, http_parse_error error) {
+			std::string result;
+
+			while (pred(peek())) {
+				result.push_back(get());
+				expect(result.size() <= max_length, error);
+			}
+			return result;
+		}
+
+		http_version_type parse_digit() {
+			const char ch = get();
+			expect(ch >= '0' && ch <= '9', http_parse_error::bad_version);
+			return ch - '0';
+		}
+
+		http_header_value parse_value() {
+			http_header_value value;
+			bool space = false;
+
+			while (true) {
+				if (take(is_http_ws)) {
+					space = !value.empty();
+				} else if (!is_http_ctl(peek())) {
+					if (std::exchange(space, false))
+						value.push_back(' ');
+
+					value.push_back(get());
+					expect(value.size() <= http_header_value_max_length, http_parse_error::header_value_too_long);
+				} else if (parse_eol()) {
+					if (!is_http_ws(peek()))
+						return value;
+				} else {
+					throw http_parse_error::bad_header_value;
+				}
+			}
+		}
+
+		void parse_header_map(http_message& message) {
+			std::size_t length = 0;
+			std::size_t size = 0;
+
+			while (is_http_token(peek())) {
+				http_header_key key =
+					parse_string(is_http_token, http_header_key_max_length, http_parse_error::header_key_too_long);
+				expect(take(':'), http_parse_error::bad_header_key);
+				expect(!key.empty(), http_parse_error::empty_header_key);
+
+				http_header_value value = parse_value();
+				length += 1;
+				size += value.size();
+
+				if (message.has_header(key)) {
+					value = std::format("{}, {}", message.header(key), value);
+				} else {
+					size += key.size();
+				}
+
+				expect(length <= http_header_map_max_length, http_parse_error::header_map_too_long);
+				expect(size <= http_header_map_max_size, http_parse_error::header_map_too_large);
+				message.set_header(key, value);
+			}
+
+			expect(parse_eol(), http_parse_error::bad_header);
+		}
+
+	public:
+		explicit reference_parser(std::string_view input) : _input(input) {}
+
+		http_request parse() {
+			http_request_method method =
+				parse_string(is_http_token, http_request_method_max_length, http_parse_error::request_method_too_long);
+			expect(take(' '), http_parse_error::bad_request_method);
+			expect(!method.empty(), http_parse_error::empty_request_method);
+			std::string uri =
+				parse_string(is_http_uri, http_request_uri_max_length, http_parse_error::request_uri_too_long);
+			expect(take(' '), http_parse_error::bad_request_uri);
+
+			expect(take("HTTP/"), http_parse_error::bad_version);
+			const http_version_type major = parse_digit();
+			expect(take('.'), http_parse_error::bad_version);
+			const http_version_type minor = parse_digit();
+			expect(parse_eol(), http_parse_error::bad_version);
+
+			http_request request(http_version(major, minor), method, parse_uri(uri, method));
+			parse_header_map(request);
+			return request;
+		}
+
+		std::string_view rest() const {
+			return _input.substr(_pos);
+		}
+	};
+
+	// what parsing one input led to: the request and the bytes after it, or the error
+	struct outcome {
+		std::optional<http_request> request;
+		std::string rest;
+		std::optional<http_parse_error> http_error;
+		std::optional<uri_parse_error> uri_error;
+	};
+
+	task<std::string> read_rest(buffered_istream_reference stream) {
+		std::string rest;
+
+		while (true) {
+			auto [buffer, size] = co_await stream.fill_buf();
+
+			if (size == 0)
+				co_return rest;
+			rest.append(buffer, size);
+			stream.consume(size);
+		}
+	}
+
+	template <class Parse>
+	outcome run(Parse parse) {
+		outcome result;
+
+		try {
+			parse(result);
+		} catch (http_parse_error error) {
+			result.http_error = error;
+		} catch (uri_parse_error error) {
+			result.uri_error = error;
+		}
+		return result;
+	}
+
+	bool same_request(const http_request& a, const http_request& b) {
+		if (a.method() != b.method() || a.uri().string() != b.uri().string())
+			return false;
+		if (a.version().major() != b.version().major() || a.version().minor() != b.version().minor())
+			return false;
+		return std::equal(a.header_map().begin(), a.header_map().end(), b.header_map().begin(), b.header_map().end());
+	}
+
+	bool same_outcome(const outcome& a, const outcome& b) {
+		if (a.http_error != b.http_error || a.uri_error != b.uri_error || a.request.has_value() != b.request.has_value())
+			return false;
+		return !a.request || (same_request(*a.request, *b.request) && a.rest == b.rest);
+	}
+} // namespace
+
+// Cross-checks parse_http_request against the byte at a time reference parser: the same request, the same bytes
+// left in the stream, or the same error. Buffer sizes of 1 and 7 make every token straddle fill_buf windows, the
+// requests live in an arena like they do in the server.
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
-	std::stringstream stream(std::string(reinterpret_cast<const char*>(data), size));
 	using namespace cobra;
+	static constexpr std::size_t buffer_sizes[] = {1, 7, 1024};
+
+	const std::string input(reinterpret_cast<const char*>(data), size);
+
+	const outcome expected = run([&input](outcome& result) {
+		reference_parser parser(input);
+		result.request.emplace(parser.parse());
+		result.rest = parser.rest();
+	});
+
+	for (std::size_t buffer_size : buffer_sizes) {
+		std::pmr::monotonic_buffer_resource arena;
 
-	try {
-		auto cobra_stream = std_istream<std::stringstream>(std::move(stream));
-		auto cobra_stream_buf = istream_buffer(std::move(cobra_stream), 1024);
-		block_task(parse_http_request(cobra_stream_buf));
+		const outcome actual = run([&input, buffer_size, &arena](outcome& result) {
+			auto cobra_stream = std_istream<std::stringstream>(std::stringstream(input));
+			auto cobra_stream_buf = istream_buffer(std::move(cobra_stream), buffer_size);
+			result.request.emplace(block_task(parse_http_request(cobra_stream_buf, &arena)));
+			result.rest = block_task(read_rest(cobra_stream_buf));
+		});
 
-	} catch (http_parse_error) {
-	} catch (uri_parse_error) {
+		if (!same_outcome(expected, actual))
+			std::abort();
 	}
 	return 0;
 }
@@ -0,0 +1,39 @@
+#include <cstdint>
+#include <cstdlib>
+#include "cobra/http/scan.hh"
+#include "cobra/http/util.hh"
+#include <cstddef>
+
+#ifdef COBRA_FUZZ_SCAN
+
+// Cross-checks every scan kernel the cpu supports against the scalar one, at every start offset of the first 32
+// bytes so that the vector loads see all alignments and tail lengths.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	using namespace cobra;
+
+	const char* chars = reinterpret_cast<const char*>(data);
+	const http_char_set* sets[] = {&http_token_chars, &http_uri_chars, &http_ws_chars, &http_ctl_chars, &http_value_delimiters};
+
+	for (std::size_t i = 0; i < size; ++i) {
+		if (http_token_chars.contains(chars[i]) != is_http_token(chars[i]) || http_uri_chars.contains(chars[i]) != is_http_uri(chars[i]))
+			std::abort();
+	}
+
+	for (const http_char_set* set : sets) {
+		for (std::size_t offset = 0; offset < size && offset < 32; ++offset) {
+			const std::size_t expected_while = scan_while(scan_kernel::scalar, *set, chars + offset, size - offset);
+			const std::size_t expected_until = scan_until(scan_kernel::scalar, *set, chars + offset, size - offset);
+
+			for (scan_kernel kernel : {scan_kernel::ssse3, scan_kernel::avx2}) {
+				if (!scan_kernel_supported(kernel))
+					continue;
+				if (scan_while(kernel, *set, chars + offset, size - offset) != expected_while)
+					std::abort();
+				if (scan_until(kernel, *set, chars + offset, size - offset) != expected_until)
+					std::abort();
+			}
+		}
+	}
+	return 0;
+}
+#endif
@@ -7,10 +7,16 @@
 #include "cobra/fastcgi.hh"
 #include "cobra/serde.hh"
 #include "cobra/asyncio/deflate.hh"
+#include "cobra/asyncio/generator.hh"
+#include "cobra/asyncio/task_group.hh"
 
 #include <fstream>
+#include <iostream>
 
 namespace cobra {
+	// how long a cgi script may keep running after it closed its output before it gets killed
+	static constexpr std::chrono::seconds cgi_exit_timeout(5);
+
 	// TODO: sanitize header keys and values
 	static generator<std::pair<std::string, std::string>> get_cgi_params(const handle_context<cgi_config>& context, const std::string& path) {
 		co_yield { "REQUEST_METHOD", context.request().method() };
@@ -22,12 +28,12 @@ namespace cobra {
 			co_yield { "QUERY_STRING", *query };
 		}
 
-		if (context.request().has_header("Content-Length")) {
-			co_yield { "CONTENT_LENGTH", context.request().header("Content-Length") };
+		if (context.request().has_header(http_header::content_length)) {
+			co_yield { "CONTENT_LENGTH", std::string(context.request().header(http_header::content_length)) };
 		}
 
-		if (context.request().has_header("Content-Type")) {
-			co_yield { "CONTENT_TYPE", context.request().header("Content-Type") };
+		if (context.request().has_header(http_header::content_type)) {
+			co_yield { "CONTENT_TYPE", std::string(context.request().header(http_header::content_type)) };
 		}
 
 		for (const auto& [http_key, http_value] : context.request().header_map()) {
@@ -37,7 +43,7 @@ namespace cobra {
 				key.push_back(ch == '-' ? '_' : std::toupper(ch));
 			}
 
-			co_yield { key, http_value };
+			co_yield { key, std::string(http_value) };
 		}
 	}
 
@@ -98,10 +104,10 @@ namespace cobra {
 
 		if (!found) {
 			http_request request("GET", parse_uri("/404", "GET"));
-			request.set_header("Host", "http.cat");
+			request.set_header(http_header::host, "http.cat");
 			auto [_, data] = co_await send_https_request(context.exec(), context.loop(), request, "http.cat");
 			http_response response(HTTP_NOT_FOUND);
-			response.set_header("Content-Type", "image/jpeg");
+			response.set_header(http_header::content_type, "image/jpeg");
 			http_ostream ostream = co_await std::move(writer).send(response);
 			co_await ostream.write_all(data.data(), data.size());
 			co_await ostream.flush();
@@ -112,19 +118,19 @@ namespace cobra {
 		http_header_map header_map = co_await parse_cgi(istream);
 		http_response_code code = 200;
 
-		if (header_map.contains("Status")) {
+		if (header_map.contains(http_header::status)) {
 			// TODO: use reason phrase from status
-			code = std::stoi(header_map.at("Status").substr(0, 3));
+			code = std::stoi(std::string(header_map.at(http_header::status).substr(0, 3)));
 		}
 
 		http_response response(code);
 
-		if (header_map.contains("Location")) {
-			response.set_header("Location", header_map.at("Location"));
+		if (header_map.contains(http_header::location)) {
+			response.set_header(http_header::location, header_map.at(http_header::location));
 		}
 
-		if (header_map.contains("Content-Type")) {
-			response.set_header("Content-Type", header_map.at("Content-Type"));
+		if (header_map.contains(http_header::content_type)) {
+			response.set_header(http_header::content_type, header_map.at(http_header::content_type));
 		}
 
 		if (code != 404 || is_last) {
@@ -143,6 +149,10 @@ namespace cobra {
 			const std::string& path = try_files[i];
 			bool is_last = i == try_files.size() - 1;
 			std::optional<http_response_writer> writer_opt;
+			// stopped when either side of the exchange fails, so the other one does not wait on a dead peer forever
+			std::stop_source stop;
+			// or when the client goes away while the script is still busy
+			std::stop_callback hangup(context.hangup_token(), [&stop] { stop.request_stop(); });
 
 			if (const auto* config = context.config().cmd()) {
 				command cmd({ config->cmd(), path });
@@ -155,26 +165,37 @@ namespace cobra {
 				}
 
 				process proc = cmd.spawn(context.loop());
+				proc.set_stop_token(stop.get_token());
 				istream_buffer proc_istream(make_istream_ref(proc.out()), 1024);
 				ostream_buffer proc_ostream(make_ostream_ref(proc.in()), 1024);
 
-				auto proc_writer = context.exec()->schedule([](auto sock, auto& proc) -> task<void> {
+				auto proc_writer = [](auto sock, auto& proc) -> task<void> {
 					co_await pipe(sock, ostream_reference(proc));
 					proc.inner().ptr()->close();
-				}(context.istream(), proc_ostream));
+				}(context.istream(), proc_ostream);
 
-				auto sock_writer = context.exec()->schedule([is_last](auto& proc, auto writer) -> task<std::optional<http_response_writer>> {
+				auto sock_writer = [](auto& proc, auto writer, bool is_last) -> task<std::optional<http_response_writer>> {
 					co_return co_await handle_cgi_response(proc, std::move(writer), is_last);
-				}(proc_istream, std::move(writer)));
+				}(proc_istream, std::move(writer), is_last);
+
+				std::exception_ptr error;
+
+				try {
+					writer_opt = std::get<1>(co_await when_all(stop, std::move(proc_writer), std::move(sock_writer)));
+				} catch (...) {
+					error = std::current_exception();
+				}
 
-				co_await proc_writer;
-				writer_opt = co_await sock_writer;
-				co_await proc.wait();
+				// a script whose exchange failed is of no use anymore, so it is killed right away
+				co_await proc.wait(error ? std::chrono::milliseconds(0) : cgi_exit_timeout);
+				if (error)
+					std::rethrow_exception(error);
 			} else if (const auto* config = context.config().addr()) {
 				socket_stream fcgi = co_await open_connection(context.loop(), config->node().c_str(), config->service().c_str());
+				fcgi.set_stop_token(stop.get_token());
 				istream_buffer fcgi_connection_istream(make_istream_ref(fcgi), 1024);
 				ostream_buffer fcgi_connection_ostream(make_ostream_ref(fcgi), 1024);
-				fastcgi_client_connection fcgi_connection(fcgi_connection_istream, fcgi_connection_ostream);
+				fastcgi_client_connection fcgi_connection(fcgi_connection_istream, fcgi_connection_ostream, stop.get_token());
 				std::shared_ptr<fastcgi_client> fcgi_client = co_await fcgi_connection.begin();
 				ostream_buffer fcgi_pstream(make_ostream_ref(fcgi_client->fcgi_params()), 1024);
 				istream_buffer fcgi_istream(make_istream_ref(fcgi_client->fcgi_stdout()), 1024);
@@ -191,27 +212,35 @@ namespace cobra {
 				co_await fcgi_pstream.flush();
 				co_await fcgi_pstream.inner().ptr()->close();
 
-				auto fcgi_writer = context.exec()->schedule([](auto sock, auto& fcgi) -> task<void> {
+				auto fcgi_writer = [](auto sock, auto& fcgi) -> task<void> {
 					co_await pipe(sock, ostream_reference(fcgi));
 					co_await fcgi.inner().ptr()->close();
-				}(context.istream(), fcgi_ostream));
+				}(context.istream(), fcgi_ostream);
 
-				auto sock_writer = context.exec()->schedule([is_last](auto& fcgi, auto writer) -> task<std::optional<http_response_writer>> {
+				auto sock_writer = [](auto& fcgi, auto writer, bool is_last) -> task<std::optional<http_response_writer>> {
 					co_return co_await handle_cgi_response(fcgi, std::move(writer), is_last);
-				}(fcgi_istream, std::move(writer)));
+				}(fcgi_istream, std::move(writer), is_last);
+
+				// the connection has to be polled for the streams of both writers to make progress
+				auto fcgi_poller = [](auto& fcgi_connection) -> task<void> {
+					while (co_await fcgi_connection.poll());
+				}(fcgi_connection);
 			
-				/*
-				auto fcgi_logger = context.exec()->schedule([](auto& fcgi) -> task<void> {
-					std_ostream_reference std_err(std::cerr);
-					co_await pipe(buffered_istream_reference(fcgi), ostream_reference(std_err));
-				}(fcgi_estream));
-				*/
-
-				while (co_await fcgi_connection.poll());
-
-				co_await fcgi_writer;
-				writer_opt = co_await sock_writer;
-				// co_await fcgi_logger;
+				// stderr has to be drained too, otherwise the poller ends up waiting for room in it
+				auto fcgi_logger = [](auto& fcgi) -> task<void> {
+					char buffer[1024];
+
+					while (true) {
+						std::size_t nread = co_await fcgi.read(buffer, sizeof buffer);
+
+						if (nread == 0)
+							break;
+						std::cerr.write(buffer, nread);
+					}
+				}(fcgi_estream);
+
+				writer_opt = std::get<1>(co_await when_all(stop, std::move(fcgi_writer), std::move(sock_writer),
+														   std::move(fcgi_poller), std::move(fcgi_logger)));
 			}
 
 			if (writer_opt) {
@@ -225,31 +254,33 @@ namespace cobra {
 	task<void> handle_redirect(http_response_writer writer, const handle_context<redirect_config>& context) {
 		std::string path = context.config().root() + context.file();
 		http_response response(context.config().code());
-		response.set_header("Location", path);
+		response.set_header(http_header::location, path);
 		co_await std::move(writer).send(response);
 	}
 
 	task<void> handle_proxy(http_response_writer writer, const handle_context<proxy_config>& context) {
 		socket_stream gate = co_await open_connection(context.loop(), context.config().node().c_str(), context.config().service().c_str());
+		std::stop_source stop;
+		std::stop_callback hangup(context.hangup_token(), [&stop] { stop.request_stop(); });
+		gate.set_stop_token(stop.get_token());
 		istream_buffer gate_istream(make_istream_ref(gate), 1024);
 		ostream_buffer gate_ostream(make_ostream_ref(gate), 1024);
 		http_request gate_request(context.request().method(), context.request().uri());
 
 		co_await write_http_request(gate_ostream, gate_request);
 
-		auto gate_writer = context.exec()->schedule([](auto sock, auto& gate) -> task<void> {
+		auto gate_writer = [](auto sock, auto& gate) -> task<void> {
 			co_await pipe(sock, ostream_reference(gate));
 			co_await gate.inner().ptr()->shutdown(shutdown_how::write);
-		}(context.istream(), gate_ostream));
+		}(context.istream(), gate_ostream);
 
-		auto sock_writer = context.exec()->schedule([](auto& gate, auto writer) -> task<void> {
+		auto sock_writer = [](auto& gate, auto writer) -> task<void> {
 			http_response gate_response = co_await parse_http_response(gate);
 			http_response response(gate_response.code(), gate_response.reason());
 			http_ostream sock = co_await std::move(writer).send(response);
 			co_await pipe(buffered_istream_reference(gate), ostream_reference(sock));
-		}(gate_istream, std::move(writer)));
+		}(gate_istream, std::move(writer));
 
-		co_await gate_writer;
-		co_await sock_writer;
+		co_await when_all(stop, std::move(gate_writer), std::move(sock_writer));
 	}
 }
@@ -1,5 +1,8 @@
 #include "cobra/http/message.hh"
 
+#include <cctype>
+#include <stdexcept>
+
 namespace cobra {
 	http_version::http_version(http_version_type major, http_version_type minor) : _major(major), _minor(minor) {
 	}
@@ -12,7 +15,7 @@ namespace cobra {
 		return _minor;
 	}
 
-	static http_header_key key_case(http_header_key key) {
+	static void key_case(std::pmr::string& key) {
 		bool special = true;
 
 		for (char& ch : key) {
@@ -24,50 +27,127 @@ namespace cobra {
 
 			special = !std::isalpha(ch);
 		}
+	}
+
+	http_header_map::http_header_map(allocator_type alloc) : _list(alloc) {
+	}
+
+	http_header_map::http_header_map(const http_header_map& other, allocator_type alloc)
+		: _list(other._list, alloc), _known(other._known) {
+	}
 
-		return key;
+	http_header_map::allocator_type http_header_map::get_allocator() const {
+		return _list.get_allocator();
 	}
 
-	const http_header_value& http_header_map::at(const http_header_key& key) const {
-		return _map.at(key_case(key));
+	// index in _list, the size of it if there is no such field, header is what find_http_header says about key
+	std::size_t http_header_map::find(std::optional<http_header> header, std::string_view key) const {
+		if (header) {
+			const std::uint16_t slot = _known[static_cast<std::size_t>(*header)];
+			return slot == 0 ? _list.size() : slot - 1;
+		}
+
+		for (std::size_t i = 0; i < _list.size(); ++i) {
+			if (http_header_equal(_list[i].first, key))
+				return i;
+		}
+		return _list.size();
 	}
 
-	bool http_header_map::contains(const http_header_key& key) const {
-		return _map.contains(key_case(key));
+	void http_header_map::append(std::optional<http_header> header, std::string_view key, std::string_view value) {
+		_list.emplace_back(key, value);
+		key_case(_list.back().first);
+
+		if (header)
+			_known[static_cast<std::size_t>(*header)] = static_cast<std::uint16_t>(_list.size());
 	}
 
-	bool http_header_map::insert(http_header_key key, http_header_value value) {
-		key = key_case(std::move(key));
+	std::string_view http_header_map::at(std::string_view key) const {
+		const std::size_t index = find(find_http_header(key), key);
+
+		if (index == _list.size())
+			throw std::out_of_range("no such header");
+		return _list[index].second;
+	}
 
-		if (_map.contains(key)) {
+	std::string_view http_header_map::at(http_header header) const {
+		const std::uint16_t slot = _known[static_cast<std::size_t>(header)];
+
+		if (slot == 0)
+			throw std::out_of_range("no such header");
+		return _list[slot - 1].second;
+	}
+
+	bool http_header_map::contains(std::string_view key) const {
+		return find(find_http_header(key), key) != _list.size();
+	}
+
+	bool http_header_map::contains(http_header header) const {
+		return _known[static_cast<std::size_t>(header)] != 0;
+	}
+
+	bool http_header_map::insert(std::string_view key, std::string_view value) {
+		const std::optional<http_header> header = find_http_header(key);
+
+		if (find(header, key) != _list.size()) {
 			return false;
 		} else {
-			_map.emplace(std::move(key), std::move(value));
+			append(header, key, value);
 			return true;
 		}
 	}
 
-	void http_header_map::insert_or_assign(http_header_key key, http_header_value value) {
-		_map.insert_or_assign(key_case(std::move(key)), std::move(value));
+	void http_header_map::insert_or_assign(std::string_view key, std::string_view value) {
+		const std::optional<http_header> header = find_http_header(key);
+		const std::size_t index = find(header, key);
+
+		if (index == _list.size()) {
+			append(header, key, value);
+		} else {
+			_list[index].second.assign(value);
+		}
+	}
+
+	void http_header_map::insert_or_assign(http_header header, std::string_view value) {
+		const std::uint16_t slot = _known[static_cast<std::size_t>(header)];
+
+		if (slot == 0) {
+			append(header, http_header_name(header), value);
+		} else {
+			_list[slot - 1].second.assign(value);
+		}
 	}
 
-	http_header_map::iterator http_header_map::begin() {
-		return _map.begin();
+	bool http_header_map::combine(std::string_view key, std::string_view value) {
+		const std::optional<http_header> header = find_http_header(key);
+		const std::size_t index = find(header, key);
+
+		if (index == _list.size()) {
+			append(header, key, value);
+			return true;
+		}
+
+		_list[index].second.append(", ").append(value);
+		return false;
 	}
 
-	http_header_map::const_iterator http_header_map::begin() const {
-		return _map.begin();
+	void http_header_map::reserve(std::size_t count) {
+		_list.reserve(count);
 	}
 
-	http_header_map::iterator http_header_map::end() {
-		return _map.end();
+	std::size_t http_header_map::size() const {
+		return _list.size();
+	}
+
+	http_header_map::const_iterator http_header_map::begin() const {
+		return _list.begin();
 	}
 
 	http_header_map::const_iterator http_header_map::end() const {
-		return _map.end();
+		return _list.end();
 	}
 
-	http_message::http_message(http_version version) : _version(std::move(version)) {
+	http_message::http_message(http_version version, allocator_type alloc) : _version(std::move(version)), _header_map(alloc) {
 	}
 
 	const http_version& http_message::version() const {
@@ -86,19 +166,39 @@ namespace cobra {
 		_header_map = std::move(header_map);
 	}
 
-	const http_header_value& http_message::header(const http_header_key& key) const {
+	std::string_view http_message::header(std::string_view key) const {
 		return _header_map.at(key);
 	}
 	
-	bool http_message::has_header(const http_header_key& key) const {
+	std::string_view http_message::header(http_header header) const {
+		return _header_map.at(header);
+	}
+
+	bool http_message::has_header(std::string_view key) const {
 		return _header_map.contains(key);
 	}
 
-	void http_message::set_header(http_header_key key, http_header_value value) {
-		_header_map.insert_or_assign(std::move(key), std::move(value));
+	bool http_message::has_header(http_header header) const {
+		return _header_map.contains(header);
+	}
+
+	void http_message::set_header(std::string_view key, std::string_view value) {
+		_header_map.insert_or_assign(key, value);
+	}
+
+	void http_message::set_header(http_header header, std::string_view value) {
+		_header_map.insert_or_assign(header, value);
+	}
+
+	bool http_message::combine_header(std::string_view key, std::string_view value) {
+		return _header_map.combine(key, value);
+	}
+
+	void http_message::reserve_headers(std::size_t count) {
+		_header_map.reserve(count);
 	}
 
-	http_request::http_request(http_version version, http_request_method method, http_request_uri uri) : http_message(std::move(version)), _method(std::move(method)), _uri(std::move(uri)) {
+	http_request::http_request(http_version version, http_request_method method, http_request_uri uri, allocator_type alloc) : http_message(std::move(version), alloc), _method(std::move(method)), _uri(std::move(uri)) {
 	}
 
 	http_request::http_request(http_request_method method, http_request_uri uri) : http_request({ 1, 1 }, std::move(method), std::move(uri)) {
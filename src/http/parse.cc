@@ -1,10 +1,13 @@
 #include "cobra/http/parse.hh"
+#include "cobra/http/scan.hh"
 #include "cobra/http/util.hh"
 #include "cobra/print.hh"
 
+#include <algorithm>
 #include <concepts>
 #include <functional>
 #include <format>
+#include <optional>
 
 namespace cobra {
 	static task<char> peek(buffered_istream_reference stream) {
@@ -204,6 +207,8 @@ namespace cobra {
 			throw uri_parse_error::bad_uri;
 		}
 
+		segments.reserve(std::count(string.begin(), string.end(), '/'));
+
 		for (std::size_t i = 0; i < string.size(); i++) {
 			if (string[i] == '/') {
 				if (!segment.empty()) {
@@ -256,7 +261,7 @@ namespace cobra {
 		if (query_begin != std::string_view::npos) {
 			uri_abs_path path = parse_uri_abs_path(string.substr(0, query_begin));
 			uri_query query = parse_uri_query(string.substr(query_begin + 1));
-			return uri_origin(path, query);
+			return uri_origin(std::move(path), std::move(query));
 		} else {
 			return uri_origin(parse_uri_abs_path(string), std::nullopt);
 		}
@@ -290,20 +295,225 @@ namespace cobra {
 		}
 	}
 
-	task<http_request> parse_http_request(buffered_istream_reference stream) {
-		http_request_method method = co_await parse_http_string(stream, is_http_token, http_request_method_max_length, http_parse_error::request_method_too_long);
-		assert(co_await take(stream, ' '), http_parse_error::bad_request_method);
-		assert(!method.empty(), http_parse_error::empty_request_method);
+	namespace {
+		// Parses a request incrementally out of whatever window of bytes it is fed, without ever suspending. Every
+		// state knows which byte it needs next, so runs of plain characters are copied in one go and the parser
+		// stops right after the empty line, leaving the body in the stream.
+		class request_parser {
+			enum class state {
+				method,
+				uri,
+				version,
+				request_cr,
+				request_lf,
+				header_begin,
+				key,
+				value,
+				value_lf,
+				value_fold,
+				final_lf,
+				done,
+			};
+
+			static constexpr std::string_view version_prefix = "HTTP/";
+			// room for the headers of a typical browser request, growing the list in an arena wastes the old ones
+			static constexpr std::size_t expected_headers = 16;
+
+			std::pmr::memory_resource* _resource;
+			state _state = state::method;
+			std::pmr::string _method;
+			std::pmr::string _uri;
+			// how much of "HTTP/x.y" was read
+			std::size_t _version_index = 0;
+			http_version_type _major = 0;
+			http_version_type _minor = 0;
+			std::optional<http_request> _request;
+			// reused for every field, the arena never gets back what they would leave behind
+			std::pmr::string _key;
+			std::pmr::string _value;
+			bool _space = false;
+			std::size_t _length = 0;
+			std::size_t _size = 0;
+
+			void append(std::pmr::string& string, const char* data, std::size_t count, std::size_t max_length,
+						http_parse_error error) {
+				assert(string.size() + count <= max_length, error);
+				string.append(data, count);
+			}
+
+			void parse_version(char ch) {
+				if (_version_index < version_prefix.size()) {
+					assert(ch == version_prefix[_version_index], http_parse_error::bad_version);
+				} else if (_version_index == version_prefix.size() + 1) {
+					assert(ch == '.', http_parse_error::bad_version);
+				} else {
+					assert(ch >= '0' && ch <= '9', http_parse_error::bad_version);
+					(_version_index == version_prefix.size() ? _major : _minor) = ch - '0';
+				}
+
+				if (++_version_index == version_prefix.size() + 3)
+					_state = state::request_cr;
+			}
 
-		std::string uri = co_await parse_http_string(stream, is_http_uri, http_request_uri_max_length, http_parse_error::request_uri_too_long);
-		assert(co_await take(stream, ' '), http_parse_error::bad_request_uri);
+			void finish_request_line() {
+				http_request_method method(_method.data(), _method.size());
+				http_request_uri uri = parse_uri(_uri, method);
 
-		http_version version = co_await parse_http_version(stream);
-		assert(co_await parse_http_eol(stream), http_parse_error::bad_version);
+				_request.emplace(http_version(_major, _minor), std::move(method), std::move(uri), _resource);
+				_request->reserve_headers(expected_headers);
+			}
+
+			void finish_header() {
+				_length += 1;
+				_size += _value.size();
+
+				if (_request->combine_header(_key, _value))
+					_size += _key.size();
+
+				assert(_length <= http_header_map_max_length, http_parse_error::header_map_too_long);
+				assert(_size <= http_header_map_max_size, http_parse_error::header_map_too_large);
+				_key.clear();
+				_value.clear();
+			}
 
-		http_request request(version, method, parse_uri(uri, method));
-		co_await parse_http_header_map(stream, request);
-		co_return request;
+		public:
+			request_parser(std::pmr::memory_resource* resource)
+				: _resource(resource), _method(resource), _uri(resource), _key(resource), _value(resource) {}
+
+			// returns how many bytes of data belong to the request
+			std::size_t feed(const char* data, std::size_t size) {
+				const char* it = data;
+				const char* end = data + size;
+
+				while (it != end && _state != state::done) {
+					switch (_state) {
+					case state::method: {
+						std::size_t count = scan_while(http_token_chars, it, end - it);
+						append(_method, it, count, http_request_method_max_length,
+							   http_parse_error::request_method_too_long);
+						it += count;
+
+						if (it != end) {
+							assert(*it++ == ' ', http_parse_error::bad_request_method);
+							assert(!_method.empty(), http_parse_error::empty_request_method);
+							_state = state::uri;
+						}
+						break;
+					}
+					case state::uri: {
+						std::size_t count = scan_while(http_uri_chars, it, end - it);
+						append(_uri, it, count, http_request_uri_max_length, http_parse_error::request_uri_too_long);
+						it += count;
+
+						if (it != end) {
+							assert(*it++ == ' ', http_parse_error::bad_request_uri);
+							_state = state::version;
+						}
+						break;
+					}
+					case state::version:
+						parse_version(*it++);
+						break;
+					case state::request_cr:
+						// anything that does not start an end of line belongs to the version
+						assert(*it == '\r' || *it == '\n', http_parse_error::bad_version);
+						assert(*it++ == '\r', http_parse_error::bad_eol);
+						_state = state::request_lf;
+						break;
+					case state::request_lf:
+						assert(*it++ == '\n', http_parse_error::bad_eol);
+						finish_request_line();
+						_state = state::header_begin;
+						break;
+					case state::header_begin:
+						if (http_token_chars.contains(*it)) {
+							_state = state::key;
+						} else {
+							assert(*it == '\r' || *it == '\n', http_parse_error::bad_header);
+							assert(*it++ == '\r', http_parse_error::bad_eol);
+							_state = state::final_lf;
+						}
+						break;
+					case state::key: {
+						std::size_t count = scan_while(http_token_chars, it, end - it);
+						append(_key, it, count, http_header_key_max_length, http_parse_error::header_key_too_long);
+						it += count;
+
+						if (it != end) {
+							assert(*it++ == ':', http_parse_error::bad_header_key);
+							assert(!_key.empty(), http_parse_error::empty_header_key);
+							_space = false;
+							_state = state::value;
+						}
+						break;
+					}
+					case state::value:
+						if (http_ws_chars.contains(*it)) {
+							_space = !_value.empty();
+							++it;
+						} else if (!http_ctl_chars.contains(*it)) {
+							std::size_t count = scan_until(http_value_delimiters, it, end - it);
+
+							if (std::exchange(_space, false))
+								_value.push_back(' ');
+							append(_value, it, count, http_header_value_max_length,
+								   http_parse_error::header_value_too_long);
+							it += count;
+						} else {
+							assert(*it == '\r' || *it == '\n', http_parse_error::bad_header_value);
+							assert(*it++ == '\r', http_parse_error::bad_eol);
+							_state = state::value_lf;
+						}
+						break;
+					case state::value_lf:
+						assert(*it++ == '\n', http_parse_error::bad_eol);
+						_state = state::value_fold;
+						break;
+					case state::value_fold:
+						// obsolete line folding, a line that starts with whitespace continues the value
+						if (!http_ws_chars.contains(*it)) {
+							finish_header();
+							_state = state::header_begin;
+						} else {
+							_state = state::value;
+						}
+						break;
+					case state::final_lf:
+						assert(*it++ == '\n', http_parse_error::bad_eol);
+						_state = state::done;
+						break;
+					case state::done:
+						break;
+					}
+				}
+
+				return it - data;
+			}
+
+			inline bool done() const {
+				return _state == state::done;
+			}
+
+			inline http_request take() {
+				return std::move(*_request);
+			}
+		};
+	} // namespace
+
+	task<http_request> parse_http_request(buffered_istream_reference stream, std::pmr::memory_resource* resource) {
+		request_parser parser(resource);
+
+		while (true) {
+			auto [buffer, size] = co_await stream.fill_buf();
+
+			if (size == 0)
+				throw http_parse_error::unexpected_eof;
+
+			stream.consume(parser.feed(buffer, size));
+
+			if (parser.done())
+				co_return parser.take();
+		}
 	}
 
 	task<http_response> parse_http_response(buffered_istream_reference stream) {
@@ -0,0 +1,158 @@
+#include "cobra/http/scan.hh"
+#include "cobra/http/util.hh"
+
+#include <bit>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define COBRA_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace cobra {
+	const http_char_set http_token_chars(is_http_token);
+	const http_char_set http_uri_chars(is_http_uri);
+	const http_char_set http_ws_chars(is_http_ws);
+	const http_char_set http_ctl_chars(is_http_ctl);
+	const http_char_set http_value_delimiters([](char ch) { return is_http_ws(ch) || is_http_ctl(ch); });
+
+	namespace {
+		using detail::scan_function;
+
+		// Until is false to scan over the characters in the set and true to scan up to the first one in it
+		template <bool Until>
+		std::size_t scan_scalar(const http_char_set& set, const char* data, std::size_t size) noexcept {
+			std::size_t i = 0;
+
+			while (i < size && set.contains(data[i]) != Until)
+				++i;
+			return i;
+		}
+
+#ifdef COBRA_SCAN_X86
+		// Each kernel looks up the column of every byte by its low nibble and tests the bit of its high nibble in
+		// there, high nibbles of 8 and up map to no bit at all. The tail that does not fill a whole vector is left
+		// to the scalar loop, loading past the end could cross into an unmapped page.
+
+		// bit i is set if byte i ends the scan, always inlined so that the avx2 kernel gets it vex encoded too,
+		// mixing in legacy sse code after touching the upper halves costs a state transition
+		template <bool Until>
+		__attribute__((target("ssse3"), always_inline)) inline unsigned scan_block16(__m128i columns,
+																					  const char* data) noexcept {
+			const __m128i rows = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+			const __m128i nibble = _mm_set1_epi8(0x0f);
+			const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+			const __m128i column = _mm_shuffle_epi8(columns, _mm_and_si128(bytes, nibble));
+			const __m128i row = _mm_shuffle_epi8(rows, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+			const __m128i outside = _mm_cmpeq_epi8(_mm_and_si128(column, row), _mm_setzero_si128());
+
+			return static_cast<unsigned>(_mm_movemask_epi8(outside)) ^ (Until ? 0xffff : 0);
+		}
+
+		template <bool Until>
+		__attribute__((target("ssse3"))) std::size_t scan_ssse3(const http_char_set& set, const char* data,
+																 std::size_t size) noexcept {
+			const __m128i columns = _mm_load_si128(reinterpret_cast<const __m128i*>(set.columns()));
+			std::size_t i = 0;
+
+			for (; i + 16 <= size; i += 16) {
+				if (unsigned mask = scan_block16<Until>(columns, data + i))
+					return i + std::countr_zero(mask);
+			}
+			return i + scan_scalar<Until>(set, data + i, size - i);
+		}
+
+		template <bool Until>
+		__attribute__((target("avx2"))) std::size_t scan_avx2(const http_char_set& set, const char* data,
+															   std::size_t size) noexcept {
+			const __m128i columns = _mm_load_si128(reinterpret_cast<const __m128i*>(set.columns()));
+			std::size_t i = 0;
+
+			// most tokens and values are short, a first half sized step finds their end without going wide
+			if (size >= 16) {
+				if (unsigned mask = scan_block16<Until>(columns, data))
+					return std::countr_zero(mask);
+				i = 16;
+			}
+
+			// shuffles stay within their 128 bit lane, so both lanes get the same tables
+			const __m256i wide_columns = _mm256_broadcastsi128_si256(columns);
+			const __m256i rows = _mm256_broadcastsi128_si256(
+				_mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0));
+			const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+			for (; i + 32 <= size; i += 32) {
+				const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				const __m256i column = _mm256_shuffle_epi8(wide_columns, _mm256_and_si256(bytes, nibble));
+				const __m256i row = _mm256_shuffle_epi8(rows, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+				const __m256i outside = _mm256_cmpeq_epi8(_mm256_and_si256(column, row), _mm256_setzero_si256());
+				const std::uint32_t mask =
+					static_cast<std::uint32_t>(_mm256_movemask_epi8(outside)) ^ (Until ? 0xffffffffu : 0);
+
+				if (mask != 0)
+					return i + std::countr_zero(mask);
+			}
+
+			if (i + 16 <= size) {
+				if (unsigned mask = scan_block16<Until>(columns, data + i))
+					return i + std::countr_zero(mask);
+				i += 16;
+			}
+			return i + scan_scalar<Until>(set, data + i, size - i);
+		}
+#endif
+
+		struct scan_functions {
+			scan_function scan_while;
+			scan_function scan_until;
+		};
+
+		scan_functions functions(scan_kernel kernel) noexcept {
+			switch (kernel) {
+#ifdef COBRA_SCAN_X86
+			case scan_kernel::avx2:
+				return {scan_avx2<false>, scan_avx2<true>};
+			case scan_kernel::ssse3:
+				return {scan_ssse3<false>, scan_ssse3<true>};
+#endif
+			default:
+				return {scan_scalar<false>, scan_scalar<true>};
+			}
+		}
+
+		scan_kernel detect_scan_kernel() noexcept {
+#ifdef COBRA_SCAN_X86
+			// this may run before the constructor that initializes the cpu model
+			__builtin_cpu_init();
+
+			if (__builtin_cpu_supports("avx2"))
+				return scan_kernel::avx2;
+			if (__builtin_cpu_supports("ssse3"))
+				return scan_kernel::ssse3;
+#endif
+			return scan_kernel::scalar;
+		}
+
+		const scan_kernel best_kernel = detect_scan_kernel();
+	} // namespace
+
+	namespace detail {
+		const scan_function active_scan_while = functions(best_kernel).scan_while;
+		const scan_function active_scan_until = functions(best_kernel).scan_until;
+	} // namespace detail
+
+	scan_kernel active_scan_kernel() noexcept {
+		return best_kernel;
+	}
+
+	bool scan_kernel_supported(scan_kernel kernel) noexcept {
+		return kernel <= best_kernel;
+	}
+
+	std::size_t scan_while(scan_kernel kernel, const http_char_set& set, const char* data, std::size_t size) noexcept {
+		return functions(kernel).scan_while(set, data, size);
+	}
+
+	std::size_t scan_until(scan_kernel kernel, const http_char_set& set, const char* data, std::size_t size) noexcept {
+		return functions(kernel).scan_until(set, data, size);
+	}
+} // namespace cobra
@@ -2,9 +2,12 @@
 
 #include "cobra/asyncio/stream_buffer.hh"
 #include "cobra/config.hh"
+#include "cobra/http/arena.hh"
 #include "cobra/http/handler.hh"
 #include "cobra/http/parse.hh"
+#include "cobra/asyncio/task_group.hh"
 
+#include <algorithm>
 #include <exception>
 #include <iterator>
 #include <map>
@@ -12,6 +15,8 @@
 #include <optional>
 #include <queue>
 #include <cassert>
+#include <cctype>
+#include <charconv>
 #include <ranges>
 #include <stdexcept>
 #include <unordered_map>
@@ -51,10 +56,10 @@ namespace cobra {
 					return false;
 				}
 			} else {
-				if (!request.has_header("host")) {
+				if (!request.has_header(http_header::host)) {
 					return false;
 				}
-				if (!config().server_names.contains(request.header("host"))) {
+				if (!config().server_names.contains(std::string(request.header(http_header::host)))) {
 					return false;
 				}
 			}
@@ -88,43 +93,190 @@ namespace cobra {
 		: http_filter(std::shared_ptr<config::config>(new config::config()), std::move(filters)),
 		  _address(std::move(address)), _contexts(std::move(contexts)), _exec(exec), _loop(loop) {}
 
+	// Connection is a comma separated list of options, matched without regard to case
+	static bool has_connection_option(const http_request& request, std::string_view option) {
+		if (!request.has_header(http_header::connection))
+			return false;
+
+		std::string_view value = request.header(http_header::connection);
+
+		while (!value.empty()) {
+			const std::size_t comma = std::min(value.find(','), value.size());
+			std::string_view part = value.substr(0, comma);
+
+			part.remove_prefix(std::min(part.find_first_not_of(" \t"), part.size()));
+			part.remove_suffix(part.size() - std::min(part.find_last_not_of(" \t") + 1, part.size()));
+
+			if (std::ranges::equal(part, option, [](char a, char b) { return std::tolower(a) == std::tolower(b); }))
+				return true;
+			value.remove_prefix(std::min(comma + 1, value.size()));
+		}
+		return false;
+	}
+
+	static bool is_http_1_1(const http_version& version) {
+		return version.major() > 1 || (version.major() == 1 && version.minor() >= 1);
+	}
+
+	// HTTP/1.1 connections persist unless the client says otherwise, older ones only when it asks for it
+	static bool wants_keep_alive(const http_request& request) {
+		// the end of a body in a transfer coding can not be found, so whatever follows it can not be read
+		if (request.has_header(http_header::transfer_encoding))
+			return false;
+		// handlers send bodies for HEAD requests too
+		if (request.method() == "HEAD")
+			return false;
+		if (is_http_1_1(request.version()))
+			return !has_connection_option(request, "close");
+		return has_connection_option(request, "keep-alive");
+	}
+
+	static std::size_t content_length(const http_request& request) {
+		if (!request.has_header(http_header::content_length))
+			return 0;
+
+		const std::string_view value = request.header(http_header::content_length);
+		std::size_t length = 0;
+		const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), length);
+
+		if (ec != std::errc() || end != value.data() + value.size())
+			throw http_parse_error::bad_header_value;
+		return length;
+	}
+
+	static task<void> watch_hangup(basic_socket_stream& socket, std::stop_token token, std::stop_source& hangup) {
+		try {
+			const bool hung_up = co_await socket.wait_hangup(std::move(token));
+
+			if (hung_up)
+				hangup.request_stop();
+		} catch (...) {
+			// cancelled once the exchange is over, a socket that can not be watched is served without it
+		}
+	}
+
+	// Runs an exchange with a backend while watching the client, so a client that goes away while the backend is
+	// still working on its response stops it through hangup. Nothing reads the client then, the exchange would only
+	// notice once the response can not be written.
+	static task<void> with_hangup(basic_socket_stream& socket, std::stop_source& hangup, task<void> exchange) {
+		std::stop_source done;
+		task_group watcher;
+		std::exception_ptr error;
+
+		watcher.spawn(watch_hangup(socket, done.get_token(), hangup));
+
+		try {
+			co_await exchange;
+		} catch (...) {
+			error = std::current_exception();
+		}
+
+		done.request_stop();
+		co_await watcher.join();
+		if (error)
+			std::rethrow_exception(error);
+	}
+
 	task<void> server::on_connect(basic_socket_stream& socket) {
 		istream_buffer socket_istream(make_istream_ref(socket), 1024);
 		ostream_buffer socket_ostream(make_ostream_ref(socket), 1024);
+
+		// declared before the requests, whose headers live in it
+		request_arena arena;
+		std::stop_source hangup;
+
+		for (std::size_t served = 0; served < _keepalive_requests; ++served) {
+			if (served > 0) {
+				bool idle = false;
+
+				// a pipelined request may already be buffered, otherwise the connection idles until the next one
+				try {
+					if (socket_istream.available() == 0)
+						co_await socket.wait_readable(_keepalive_timeout);
+
+					auto [_, size] = co_await socket_istream.fill_buf();
+					idle = size == 0;
+				} catch (...) {
+					// timed out or reset, either way there is nobody to answer to
+					idle = true;
+				}
+
+				if (idle)
+					break;
+				arena.release();
+			}
+
+			const bool keep_alive = co_await serve(socket, socket_istream, socket_ostream, arena.resource(),
+												   served + 1 == _keepalive_requests, hangup);
+
+			if (!keep_alive)
+				break;
+		}
+	}
+
+	task<bool> server::serve(basic_socket_stream& socket, buffered_istream_reference in, buffered_ostream_reference out,
+							 std::pmr::memory_resource* resource, bool last, std::stop_source& hangup) {
 		http_server_logger logger;
-		http_response_writer writer(socket_ostream, &logger);
+		http_response_state state;
+		http_response_writer writer(out, &logger, &state);
 		logger.set_socket(socket);
 
-		http_request request("GET", parse_uri("/", "GET"));
+		std::optional<http_request> parsed;
+		std::optional<istream_limit<buffered_istream_reference>> body;
 		bool bad_request = false;
 		bool unknown_error = false;
+		std::size_t discard_limit = max_discard;
 
 		try {
-			request = co_await parse_http_request(socket_istream);
+			parsed.emplace(co_await parse_http_request(in, resource));
+			const http_request& request = *parsed;
 			logger.set_request(request);
 
+			body.emplace(buffered_istream_reference(in), content_length(request));
+			state.keep_alive = !last && wants_keep_alive(request);
+			state.chunked = is_http_1_1(request.version());
+
 			const uri_origin* org = request.uri().get<uri_origin>();
 			if (!org) {
 				eprintln("request did not contain uri_origin");
 				co_await std::move(writer).send(HTTP_BAD_REQUEST);
-				co_return;
-			}
-			const uri_abs_path normalized = org->path().normalize();
+			} else {
+				const uri_abs_path normalized = org->path().normalize();
+
+				auto filter = match(socket, request, normalized);
 
-			auto filter = match(socket, request, normalized);
+				if (filter && filter->config().max_body_size)
+					discard_limit = std::min(discard_limit, *filter->config().max_body_size);
 
-			if (!filter || !filter->config().handler) {
-				if (!filter)
-					std::cerr << "no filter matched" << std::endl;
-				else if (!filter->config().handler)
-					std::cerr << "no handler" << std::endl;
-				co_await std::move(writer).send(HTTP_NOT_FOUND);
-				co_return;
+				if (!filter || !filter->config().handler) {
+					if (!filter)
+						std::cerr << "no filter matched" << std::endl;
+					else if (!filter->config().handler)
+						std::cerr << "no handler" << std::endl;
+					co_await std::move(writer).send(HTTP_NOT_FOUND);
+				} else {
+					co_await handle_request(*filter, request, normalized, *body, std::move(writer), socket, hangup);
+				}
 			}
 
-			co_await handle_request(*filter, request, normalized, socket_istream, std::move(writer));
-			// co_await (*handler)(std::move(writer), std::move(request), buffered_istream_reference(socket_istream));
-			// TODO limit socket_istream to client content-length
+			if (state.framing == http_body_framing::chunked)
+				co_await http_chunked_ostream::finish(out);
+			else
+				co_await out.flush();
+
+			// whatever the handler left of the body comes before the next request, a large rest is cheaper to get rid
+			// of by closing the connection
+			if (state.keep_alive && body->limit() > discard_limit) {
+				state.keep_alive = false;
+			} else if (state.keep_alive) {
+				while (true) {
+					auto [_, size] = co_await body->fill_buf();
+
+					if (size == 0)
+						break;
+					body->consume(size);
+				}
+			}
 		} catch (http_parse_error err) {
 			bad_request = true;
 		} catch (uri_parse_error err) {
@@ -137,17 +289,21 @@ namespace cobra {
 			std::cerr << "something went very very wrong" << std::endl;
 		}
 
-		if (bad_request) {
-			co_await std::move(writer).send(HTTP_BAD_REQUEST);
-			co_return;
-		} else if (unknown_error) {
-			co_await std::move(writer).send(HTTP_INTERNAL_SERVER_ERROR);
-			co_return;
+		// a response that is already under way can not be replaced by another one
+		if ((bad_request || unknown_error) && !state.sent) {
+			// after a failure it is unknown where the next request would start
+			state.keep_alive = false;
+			co_await std::move(writer).send(bad_request ? HTTP_BAD_REQUEST : HTTP_INTERNAL_SERVER_ERROR);
+			co_await out.flush();
+			co_return false;
 		}
+
+		co_return !bad_request && !unknown_error && state.sent && state.keep_alive && body && body->limit() == 0;
 	}
 
 	task<void> server::handle_request(const http_filter& filt, const http_request& request, const uri_abs_path& normalized,
-									  buffered_istream_reference in, http_response_writer writer) {
+									  buffered_istream_reference in, http_response_writer writer,
+									  basic_socket_stream& socket, std::stop_source& hangup) {
 		// TODO write headers set in config
 		// TODO properly match uri
 		fs::path file("/");
@@ -155,42 +311,40 @@ namespace cobra {
 			file.append(normalized[i]);
 		}
 
-		// TODO do properly: https://datatracker.ietf.org/doc/html/rfc9112#name-message-body-length
-		// TODO utility file for int parsing etc..
-		std::size_t content_length =
-			request.has_header("content-length") ? std::stoull(request.header("content-length")) : 0;
-		auto limited_stream = istream_limit(std::move(in), content_length);
-
 		//TODO do without allocations
 		auto root = filt.config().root.value_or("").string();
 		auto index = std::vector<std::string>(1, filt.config().index.value_or("").string());
 
 		if (auto cfg = std::get_if<config::cgi_config>(&*filt.config().handler)) {
-			co_await handle_cgi(std::move(writer),
-								{_loop, _exec, root, file.string(), index, // TODO avoid duplicating strings
-								 cgi_config(cgi_command(cfg->command.file())), request, limited_stream});
+			co_await with_hangup(socket, hangup,
+								 handle_cgi(std::move(writer),
+											{_loop, _exec, root, file.string(), index, // TODO avoid duplicating strings
+											 cgi_config(cgi_command(cfg->command.file())), request, in,
+											 hangup.get_token()}));
 		} else if (auto cfg = std::get_if<config::fast_cgi_config>(&*filt.config().handler)) {
 			auto service = std::format("{}", cfg->address.service());
-			co_await handle_cgi(std::move(writer),
-								{_loop, _exec, root, file.string(), index,
-								 cgi_config(cgi_address(cfg->address.node(), service)),
-								 request, limited_stream});
+			co_await with_hangup(socket, hangup,
+								 handle_cgi(std::move(writer),
+											{_loop, _exec, root, file.string(), index,
+											 cgi_config(cgi_address(cfg->address.node(), service)), request, in,
+											 hangup.get_token()}));
 		} else if (auto cfg = std::get_if<config::static_file_config>(&*filt.config().handler)) {
 			co_await handle_static(std::move(writer),
-								   {_loop, _exec, root, file.string(), index, {}, request, limited_stream});
+								   {_loop, _exec, root, file.string(), index, {}, request, in});
 		} else {
 			assert(0 && "unimplemented");
 		}
 	}
 
-	task<void> server::start(executor* exec, event_loop* loop) {
+	task<void> server::start(executor* exec, event_loop* loop, bool reuse_port) {
 		std::string service = std::to_string(_address.service());
 		if (_contexts.empty()) {
 			std::cout << _address.node() << ":" << service << std::endl;
-			co_return co_await start_server(exec, loop, _address.node().data(), service.c_str(),
+			co_return co_await start_server(loop, _address.node().data(), service.c_str(),
 											[this](socket_stream socket) -> task<void> {
 												co_return co_await on_connect(socket);
-											});
+											},
+											reuse_port);
 		} else if (_contexts.size() == 1 && _contexts.begin()->first.empty()) {
 			//No SNI
 			//TODO DOESNT WORK PROPERLY TEST!
@@ -198,14 +352,16 @@ namespace cobra {
 			co_return co_await start_ssl_server(_contexts.begin()->second, exec, loop, _address.node().data(),
 												service.c_str(), [this](ssl_socket_stream socket) -> task<void> {
 													co_return co_await on_connect(socket);
-												});
+												},
+												reuse_port);
 		} else {
 			//With SNI
 			eprintln("ssl {}:{} SNI", _address.node(), service);
 			co_return co_await start_ssl_server(_contexts, exec, loop, _address.node().data(),
 												service.c_str(), [this](ssl_socket_stream socket) -> task<void> {
 													co_return co_await on_connect(socket);
-												});
+												},
+												reuse_port);
 		}
 	}
 
@@ -213,10 +369,13 @@ namespace cobra {
 										executor* exec, event_loop* loop) {
 		std::map<config::listen_address, std::unordered_map<std::string, ssl_ctx>> contexts;
 		std::map<config::listen_address, std::vector<http_filter>> filters;
+		// connection settings come from the first server on an address, the request has not picked one yet
+		std::map<config::listen_address, std::shared_ptr<config::server>> defaults;
 
 		for (const auto& config : configs) {
 			for (const auto& address : config->addresses) {
 				filters[address].push_back(http_filter(config));
+				defaults.insert({address, config});
 				if (config->ssl) {
 					for (const auto& server_name : config->server_names) {
 						contexts[address].insert({server_name, ssl_ctx::server(config->ssl->cert(), config->ssl->key())});
@@ -233,7 +392,17 @@ namespace cobra {
 			if (contexts.contains(listen)) {
 				ssl = contexts.at(listen);
 			}
-			result.push_back(server(listen, std::move(ssl), filters, exec, loop));
+			server srv(listen, std::move(ssl), filters, exec, loop);
+			const config::server& config = *defaults.at(listen);
+
+			if (config.keepalive_timeout)
+				srv._keepalive_timeout = std::chrono::seconds(*config.keepalive_timeout);
+			if (config.keepalive_requests)
+				srv._keepalive_requests = *config.keepalive_requests;
+			// a connection that may not wait for another request serves just the one
+			if (srv._keepalive_timeout == std::chrono::milliseconds(0) || srv._keepalive_requests == 0)
+				srv._keepalive_requests = 1;
+			result.push_back(std::move(srv));
 		}
 		return result;
 	}
@@ -1,10 +1,44 @@
 #include "cobra/http/writer.hh"
 #include "cobra/print.hh"
 
+#include <charconv>
+
 namespace cobra {
+	http_chunked_ostream::http_chunked_ostream(buffered_ostream_reference stream) : _stream(stream) {}
+
+	task<std::size_t> http_chunked_ostream::write(const char_type* data, std::size_t size) {
+		// an empty chunk would end the body
+		if (size == 0)
+			co_return 0;
+
+		char head[sizeof(std::size_t) * 2 + 2];
+		char* end = std::to_chars(head, head + sizeof head, size, 16).ptr;
+		*end++ = '\r';
+		*end++ = '\n';
+
+		co_await _stream.write_all(head, end - head);
+		co_await _stream.write_all(data, size);
+		co_await _stream.write_all("\r\n", 2);
+		co_return size;
+	}
+
+	task<void> http_chunked_ostream::flush() {
+		return _stream.flush();
+	}
+
+	task<void> http_chunked_ostream::finish(buffered_ostream_reference stream) {
+		co_await stream.write_all("0\r\n\r\n", 5);
+		co_await stream.flush();
+	}
+
+	// 1xx, 204 and 304 responses end with their head
+	static bool has_body(const http_response& response) {
+		return response.code() / 100 != 1 && response.code() != HTTP_NO_CONTENT && response.code() != HTTP_NOT_MODIFIED;
+	}
+
 	static http_ostream to_stream(buffered_ostream_reference stream, const http_message& message) {
-		if (message.has_header("Content-Length")) {
-			std::size_t size = std::stoull(message.header("Content-Length"));
+		if (message.has_header(http_header::content_length)) {
+			std::size_t size = std::stoull(std::string(message.header(http_header::content_length)));
 			return ostream_limit(std::move(stream), size);
 		} else {
 			return stream;
@@ -48,6 +82,10 @@ namespace cobra {
 			print(" {} {}", _request->method(), _request->uri().string());
 		}
 
+#ifdef COBRA_DEBUG
+		print(" ({} frames)", frame_allocator::allocated() - _frames);
+#endif
+
 		println("{}", term::reset());
 	}
 
@@ -59,18 +97,42 @@ namespace cobra {
 		co_return to_stream(_stream, request);
 	}
 
-	http_response_writer::http_response_writer(buffered_ostream_reference stream, http_server_logger* logger) : _stream(stream), _logger(logger) {
+	http_response_writer::http_response_writer(buffered_ostream_reference stream, http_server_logger* logger, http_response_state* state)
+		: _stream(stream), _logger(logger), _state(state) {
 	}
 
-	// TODO: implement keep-alive
 	task<http_ostream> http_response_writer::send(http_response response)&& {
-		response.set_header("Connection", "close");
+		const bool keep_alive = _state && _state->keep_alive;
+		http_body_framing framing = http_body_framing::close;
+
+		if (response.has_header(http_header::content_length)) {
+			framing = http_body_framing::length;
+		} else if (!has_body(response)) {
+			framing = http_body_framing::none;
+		} else if (keep_alive && _state->chunked) {
+			framing = http_body_framing::chunked;
+			response.set_header(http_header::transfer_encoding, "chunked");
+		}
+
+		// a body that runs until the connection closes leaves nothing to keep alive
+		const bool reuse = keep_alive && framing != http_body_framing::close;
+		response.set_header(http_header::connection, reuse ? "keep-alive" : "close");
+
+		if (_state) {
+			_state->keep_alive = reuse;
+			_state->sent = true;
+			_state->framing = framing;
+		}
 
 		if (_logger) {
 			_logger->log(response);
 		}
 
 		co_await write_http_response(_stream, response);
+
+		if (framing == http_body_framing::chunked) {
+			co_return http_chunked_ostream(_stream);
+		}
 		co_return to_stream(_stream, response);
 	}
 
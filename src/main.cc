@@ -1,4 +1,5 @@
 #include "cobra/asyncio/event_loop.hh"
+#include "cobra/asyncio/io_uring_event_loop.hh"
 #include "cobra/asyncio/executor.hh"
 #include "cobra/asyncio/future_task.hh"
 #include "cobra/asyncio/stream.hh"
@@ -13,12 +14,17 @@
 #include "cobra/print.hh"
 #include "cobra/config.hh"
 #include "cobra/args.hh"
+#include "cobra/affinity.hh"
+#include "cobra/exception.hh"
 
+#include <condition_variable>
 #include <cstdlib>
 #include <iomanip>
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #include <cassert>
 
@@ -57,13 +63,111 @@ struct args_type {
 	bool json = false;
 	bool check = false;
 	bool help = false;
+	bool io_uring = false;
+	std::optional<std::size_t> threads;
+	std::optional<std::string> cpus;
+	std::optional<std::size_t> max_events;
+	std::optional<std::size_t> stats;
 };
 
-#ifndef COBRA_FUZZ
-int main(int argc, char **argv) {
+// the epoll loops of all reactors, for --stats. Loops are never removed, reactors run until the process exits.
+class loop_registry {
+	std::mutex _mutex;
+	std::vector<const cobra::epoll_event_loop*> _loops;
+
+public:
+	void add(const cobra::event_loop& loop) {
+		if (const auto* epoll_loop = dynamic_cast<const cobra::epoll_event_loop*>(&loop)) {
+			std::lock_guard lock(_mutex);
+			_loops.push_back(epoll_loop);
+		}
+	}
+
+	cobra::epoll_event_loop::poll_stats stats() {
+		cobra::epoll_event_loop::poll_stats result;
+		std::lock_guard lock(_mutex);
+
+		for (const cobra::epoll_event_loop* loop : _loops)
+			result += loop->stats();
+		return result;
+	}
+};
+
+static void print_stats(std::stop_token stop_token, loop_registry& registry, std::chrono::seconds interval) {
+	using namespace cobra;
+
+	std::mutex mutex;
+	std::condition_variable_any condition_variable;
+	std::unique_lock lock(mutex);
+
+	while (!condition_variable.wait_for(lock, stop_token, interval, [&stop_token] { return stop_token.stop_requested(); })) {
+		auto stats = registry.stats();
+		auto us = [](std::uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+
+		eprintln("stats: {} waits, {} events, {:.1f} events/wait, wait p50 {:.1f}us p99 {:.1f}us, lag p50 {:.1f}us "
+				 "p99 {:.1f}us max {:.1f}us",
+				 stats.waits, stats.events, stats.events_per_wait(), us(stats.wait_time.quantile(0.5)),
+				 us(stats.wait_time.quantile(0.99)), us(stats.lag.quantile(0.5)), us(stats.lag.quantile(0.99)),
+				 us(stats.lag.max));
+	}
+}
+
+static std::unique_ptr<cobra::event_loop> make_event_loop(cobra::executor& exec, bool io_uring,
+															std::size_t max_events) {
+	using namespace cobra;
+
+	if (io_uring) {
+		try {
+			return std::make_unique<io_uring_event_loop>(exec);
+		} catch (const errno_exception& ex) {
+			eprintln("io_uring unavailable ({}), falling back to epoll", ex.what());
+		}
+	}
+	return std::make_unique<epoll_event_loop>(exec, max_events);
+}
+
+// every reactor owns its executor, event loop and listening sockets, connections never leave the reactor that
+// accepted them. A pinned reactor pins itself before it allocates anything, so its memory ends up on its own node.
+static void run_reactor(const std::vector<std::shared_ptr<cobra::config::server>>& srvs, bool io_uring, bool verbose,
+						bool reuse_port, std::size_t max_events, std::optional<unsigned> cpu, loop_registry& registry) {
 	using namespace cobra;
+
+	if (cpu) {
+		try {
+			pin_thread(*cpu);
+
+			try {
+				use_local_memory();
+			} catch (const errno_exception& ex) {
+				eprintln("pinned reactor to cpu {} but failed to keep its memory on the local node ({})", *cpu,
+						 ex.what());
+			}
+		} catch (const errno_exception& ex) {
+			eprintln("failed to pin reactor to cpu {} ({}), leaving it unpinned", *cpu, ex.what());
+		}
+	}
+
 	sequential_executor exec;
-	epoll_event_loop loop(exec);
+	std::unique_ptr<event_loop> loop = make_event_loop(exec, io_uring, max_events);
+	registry.add(*loop);
+
+	std::vector<server> servers = server::convert(srvs, &exec, loop.get());
+	if (verbose)
+		eprintln("setup {} server(s)", servers.size());
+	std::vector<future_task<void>> jobs;
+
+	for (auto&& server : servers) {
+		jobs.push_back(make_future_task(server.start(&exec, loop.get(), reuse_port)));
+	}
+
+	while (true) {
+		loop->poll();
+	}
+}
+
+#if !defined(COBRA_FUZZ) && !defined(COBRA_BENCH)
+int main(int argc, char **argv) {
+	using namespace cobra;
 	std::fstream file;
 	std::istream* input = &std::cin;
 
@@ -74,6 +178,11 @@ int main(int argc, char **argv) {
 		.add_argument(&args_type::config_file, "f", "config-file", "path to configuration file")
 		.add_flag(&args_type::json, true, "j", "json", "write diagnostics in json format")
 		.add_flag(&args_type::check, true, "c", "check", "exit after reading configuration file")
+		.add_flag(&args_type::io_uring, true, "u", "io-uring", "use io_uring instead of epoll")
+		.add_argument(&args_type::threads, "t", "threads", "number of reactor threads, overrides the configuration file")
+		.add_argument(&args_type::cpus, "C", "cpus", "cpus to pin the reactors to (e.g. 0-3,8), overrides the configuration file")
+		.add_argument(&args_type::max_events, "e", "max-events", "most events an epoll loop takes per wait, overrides the configuration file")
+		.add_argument(&args_type::stats, "s", "stats", "print event loop statistics every this many seconds")
 		.add_flag(&args_type::help, true, "h", "help", "display this help message");
 	auto args = parser.parse(argv, argv + argc);
 
@@ -82,6 +191,38 @@ int main(int argc, char **argv) {
 		return EXIT_SUCCESS;
 	}
 
+	if (args.stats && *args.stats == 0) {
+		eprintln("stats interval must be at least 1 second");
+		return EXIT_FAILURE;
+	}
+
+	// only the epoll loop keeps statistics
+	if (args.stats && args.io_uring) {
+		eprintln("stats are not available with io_uring");
+		return EXIT_FAILURE;
+	}
+
+	if (args.threads && (*args.threads == 0 || *args.threads > config::global_config::max_threads)) {
+		eprintln("threads must be between 1 and {}", config::global_config::max_threads);
+		return EXIT_FAILURE;
+	}
+
+	if (args.max_events && (*args.max_events == 0 || *args.max_events > config::global_config::max_max_events)) {
+		eprintln("max events must be between 1 and {}", config::global_config::max_max_events);
+		return EXIT_FAILURE;
+	}
+
+	std::optional<std::vector<unsigned>> cpus;
+
+	if (args.cpus) {
+		try {
+			cpus = parse_cpu_list(*args.cpus);
+		} catch (const std::invalid_argument& ex) {
+			eprintln("invalid cpus: {}", ex.what());
+			return EXIT_FAILURE;
+		}
+	}
+
 	if (args.config_file) {
 		file = std::fstream(*args.config_file, std::ios::in);
 		input = &file;
@@ -93,7 +234,7 @@ int main(int argc, char **argv) {
 		const char* delim = "";
 
 		try {
-			config::server_config::parse_servers(session);
+			config::global_config::parse(session);
 		} catch (const config::error& err) {
 			session.report(err.diag());
 		}
@@ -136,32 +277,52 @@ int main(int argc, char **argv) {
 
 		try {
 			std::vector<std::shared_ptr<config::server>> srvs;
+			std::size_t threads;
+			std::size_t max_events;
 
 			{
-				std::vector<config::server_config> configs = config::server_config::parse_servers(session);
+				config::global_config global = config::global_config::parse(session);
 
-				eprintln("loaded {} server config(s)", configs.size());
-				for (auto&& config : configs) {
+				eprintln("loaded {} server config(s)", global.servers().size());
+				for (auto&& config : global.servers()) {
 					srvs.push_back(std::make_shared<config::server>(config::server(config)));
 				}
+				if (!cpus)
+					cpus = global.cpus();
+				// one reactor per listed cpu unless told otherwise
+				threads = args.threads.value_or(global.threads().value_or(cpus ? cpus->size() : 1));
+				max_events = args.max_events.value_or(global.max_events().value_or(epoll_event_loop::default_max_events));
 			}
 
-			std::vector<server> servers = server::convert(srvs, &exec, &loop);
-			eprintln("setup {} server(s)", servers.size());
-			std::vector<future_task<void>> jobs;
+			if (args.check) {
+				sequential_executor exec;
+				std::unique_ptr<event_loop> loop = make_event_loop(exec, args.io_uring, max_events);
+				std::vector<server> servers = server::convert(srvs, &exec, loop.get());
+				eprintln("setup {} server(s)", servers.size());
+			} else {
+				loop_registry registry;
+				std::vector<std::jthread> reactors;
+				std::jthread stats;
 
-			if (!args.check) {
-				for (auto&& server : servers) {
-					jobs.push_back(make_future_task(server.start(&exec, &loop)));
-				}
+				if (args.stats)
+					stats = std::jthread(print_stats, std::ref(registry), std::chrono::seconds(*args.stats));
 
-				while (true) {
-					loop.poll();
-				}
+				auto cpu_of = [&cpus](std::size_t reactor) -> std::optional<unsigned> {
+					if (cpus)
+						return (*cpus)[reactor % cpus->size()];
+					return std::nullopt;
+				};
+
+				// a single reactor keeps its listeners exclusive, so a second instance on the same port fails to bind
+				const bool reuse_port = threads > 1;
 
-				for (auto&& job : jobs) {
-					job.get_future().wait();
+				eprintln("starting {} reactor thread(s)", threads);
+				for (std::size_t i = 1; i < threads; ++i) {
+					reactors.emplace_back(run_reactor, std::cref(srvs), args.io_uring, false, reuse_port, max_events,
+										  cpu_of(i),
+										  std::ref(registry));
 				}
+				run_reactor(srvs, args.io_uring, true, reuse_port, max_events, cpu_of(0), registry);
 			}
 		} catch (const config::error& err) {
 			session.report(err.diag());
@@ -3,6 +3,7 @@
 #include "cobra/exception.hh"
 #include "cobra/print.hh"
 #include "cobra/net/address.hh"
+#include "cobra/asyncio/task_group.hh"
 
 #include <memory>
 #include <mutex>
@@ -14,40 +15,71 @@
 
 extern "C" {
 #include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <openssl/err.h>
 }
 
 namespace cobra {
-	static bool check_sock(int fd) {
-		int error;
-		socklen_t len = sizeof error;
+	basic_socket_stream::~basic_socket_stream() {}
+
+	// peeks before waiting, an edge triggered loop reports data that came in while nobody waited only once
+	static task<void> wait_peekable(event_loop* loop, const file& f, std::optional<std::chrono::milliseconds> timeout,
+									std::stop_token token = {}) {
+		char c;
 
-		check_return(getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len));
-		return error == 0;
+		while (!check_would_block(::recv(f.fd(), &c, 1, MSG_PEEK))) {
+			co_await loop->wait_read(f, timeout, token);
+		}
 	}
 
-	basic_socket_stream::~basic_socket_stream() {}
+	// waits on a duplicate of f, the loop keeps one waiter per fd and direction and that one belongs to the reads
+	static task<bool> wait_peer_hangup(event_loop* loop, const file& f, std::stop_token token) {
+		file watched = check_return(fcntl(f.fd(), F_DUPFD_CLOEXEC, 0));
+		char c;
+
+		while (true) {
+			std::optional<std::size_t> peeked;
+
+			try {
+				peeked = check_would_block(::recv(watched.fd(), &c, 1, MSG_PEEK));
+			} catch (const errno_exception&) {
+				// reset by the peer
+				co_return true;
+			}
+
+			if (peeked)
+				co_return *peeked == 0;
+			co_await loop->wait_read(watched, std::nullopt, token);
+		}
+	}
 
 	socket_stream::socket_stream(socket_stream&& other)
-		: _loop(std::exchange(other._loop, nullptr)), _file(std::move(other._file)) {}
+		: _loop(std::exchange(other._loop, nullptr)), _file(std::move(other._file)), _token(std::move(other._token)) {}
 	socket_stream::socket_stream(event_loop* loop, file&& f) : _loop(loop), _file(std::move(f)) {}
 	socket_stream::~socket_stream() {}
 
 	task<std::size_t> socket_stream::read(char_type* data, std::size_t size) {
-		co_await _loop->wait_read(_file);
-		co_return check_return(recv(_file.fd(), data, size, 0));
+		return _loop->recv(_file, data, size, _token);
 	}
 
 	task<std::size_t> socket_stream::write(const char_type* data, std::size_t size) {
-		co_await _loop->wait_write(_file);
-		co_return check_return(send(_file.fd(), data, size, 0));
+		return _loop->send(_file, data, size, _token);
 	}
 
 	task<void> socket_stream::flush() {
 		co_return;
 	}
 
+	task<void> socket_stream::wait_readable(std::optional<std::chrono::milliseconds> timeout) {
+		return wait_peekable(_loop, _file, timeout, _token);
+	}
+
+	task<bool> socket_stream::wait_hangup(std::stop_token token) {
+		return wait_peer_hangup(_loop, _file, std::move(token));
+	}
+
 	task<void> socket_stream::shutdown(shutdown_how how) {
 		int h = 0;
 		switch (how) {
@@ -371,6 +403,21 @@ namespace cobra {
 		co_return;
 	}
 
+	task<void> ssl_socket_stream::wait_readable(std::optional<std::chrono::milliseconds> timeout) {
+		// records openssl already pulled off the socket would not show up on it anymore
+		if (!can_read() || SSL_has_pending(_ssl.ptr()))
+			co_return;
+		co_await wait_peekable(_loop, _file, timeout);
+	}
+
+	task<bool> ssl_socket_stream::wait_hangup(std::stop_token token) {
+		if (!can_read())
+			co_return true;
+		if (SSL_has_pending(_ssl.ptr()))
+			co_return false;
+		co_return co_await wait_peer_hangup(_loop, _file, std::move(token));
+	}
+
 	address ssl_socket_stream::peername() const {
 		sockaddr_storage addr;
 		socklen_t len = sizeof addr;
@@ -447,10 +494,8 @@ namespace cobra {
 		for (const address_info& info : get_address_info(node, service)) {
 			file sock = check_return(socket(info.family(), info.socktype(), info.protocol()));
 			check_return(fcntl(sock.fd(), F_SETFL, O_NONBLOCK));
-			check_return(connect(sock.fd(), info.addr().addr(), info.addr().len()));
-			co_await loop->wait_write(sock);
 
-			if (check_sock(sock.fd())) {
+			if (co_await loop->connect(sock, info.addr().addr(), info.addr().len())) {
 				co_return socket_stream(loop, std::move(sock));
 			}
 		}
@@ -472,8 +517,16 @@ namespace cobra {
 		co_return co_await ssl_socket_stream::connect(exec, loop, std::move(socket), std::move(client));
 	}
 
-	task<void> start_server(executor* exec, event_loop* loop, const char* node, const char* service,
-							std::function<task<void>(socket_stream)> cb) {
+	// a failed connection only takes itself down, it is not an error of the server
+	static task<void> serve_connection(task<void> connection) {
+		try {
+			co_await connection;
+		} catch (...) {
+		}
+	}
+
+	task<void> start_server(event_loop* loop, const char* node, const char* service,
+							std::function<task<void>(socket_stream)> cb, bool reuse_port) {
 		static const int val = 1;
 
 		// TODO: should listen to all results from get_address_info
@@ -481,35 +534,52 @@ namespace cobra {
 			file server_sock = check_return(socket(info.family(), info.socktype(), info.protocol()));
 			check_return(fcntl(server_sock.fd(), F_SETFL, O_NONBLOCK));
 			check_return(setsockopt(server_sock.fd(), SOL_SOCKET, SO_REUSEADDR, &val, sizeof val));
+			// with several reactors every one binds its own listener, the kernel balances connections between them
+			if (reuse_port)
+				check_return(setsockopt(server_sock.fd(), SOL_SOCKET, SO_REUSEPORT, &val, sizeof val));
 			check_return(bind(server_sock.fd(), info.addr().addr(), info.addr().len()));
 			check_return(listen(server_sock.fd(), 5));
 
-			while (true) {
-				co_await loop->wait_read(server_sock);
-				sockaddr_storage addr;
-				socklen_t len = sizeof addr;
-				file client_sock = check_return(accept(server_sock.fd(), reinterpret_cast<sockaddr*>(&addr), &len));
-				check_return(fcntl(client_sock.fd(), F_SETFL, O_NONBLOCK));
-				(void) exec->schedule(cb(socket_stream(loop, std::move(client_sock))));
+			task_group connections;
+			std::exception_ptr error;
+
+			try {
+				while (true) {
+					file client_sock = co_await loop->accept(server_sock);
+					// a kept alive connection would otherwise hold the end of every response back until the
+					// client acknowledged its start, a socket that refuses is still served
+					setsockopt(client_sock.fd(), IPPROTO_TCP, TCP_NODELAY, &val, sizeof val);
+					connections.spawn(serve_connection(cb(socket_stream(loop, std::move(client_sock)))));
+				}
+			} catch (...) {
+				error = std::current_exception();
 			}
+
+			// the connections refer to cb, they have to be done before it goes away
+			co_await connections.join();
+			std::rethrow_exception(error);
 		}
 	}
 
 	task<void> start_ssl_server(ssl_ctx ctx, executor* exec, event_loop* loop, const char* node, const char* service,
-								std::function<task<void>(ssl_socket_stream)> cb) {
+								std::function<task<void>(ssl_socket_stream)> cb, bool reuse_port) {
 		co_await start_server(
-			exec, loop, node, service, [ctx, exec, loop, cb](socket_stream socket) mutable -> task<void> {
+			loop, node, service,
+			[ctx, exec, loop, cb](socket_stream socket) mutable -> task<void> {
 				co_await cb(co_await ssl_socket_stream::accept(exec, loop, std::move(socket), ssl(ctx)));
-			});
+			},
+			reuse_port);
 	}
 
 	task<void> start_ssl_server(std::unordered_map<std::string, ssl_ctx> server_names, executor* exec,
 								event_loop* loop, const char* node, const char* service,
-								std::function<task<void>(ssl_socket_stream)> cb) {
+								std::function<task<void>(ssl_socket_stream)> cb, bool reuse_port) {
 		ssl_ctx ctx = ssl_ctx::server(std::move(server_names));
 		co_await start_server(
-			exec, loop, node, service, [ctx, exec, loop, cb](socket_stream socket) mutable -> task<void> {
+			loop, node, service,
+			[ctx, exec, loop, cb](socket_stream socket) mutable -> task<void> {
 				co_await cb(co_await ssl_socket_stream::accept(exec, loop, std::move(socket), ssl(ctx)));
-			});
+			},
+			reuse_port);
 	}
 } // namespace cobra
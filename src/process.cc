@@ -11,7 +11,7 @@ namespace cobra {
 	process::process(event_loop* loop, int pid, file&& in, file&& out, file&& err) : process_ostream<process_stream_type::in> { {}, std::move(in) }, process_istream<process_stream_type::out> { {}, std::move(out) }, process_istream<process_stream_type::err> { {}, std::move(err) }, _pid(pid), _loop(loop) {
 	}
 
-	process::process(process&& other) : process_ostream<process_stream_type::in>(std::move<process_ostream<process_stream_type::in>&>(other)), process_istream<process_stream_type::out>(std::move<process_istream<process_stream_type::out>&>(other)), process_istream<process_stream_type::err>(std::move<process_istream<process_stream_type::err>&>(other)), _pid(std::exchange(other._pid, 1)), _loop(other._loop) {
+	process::process(process&& other) : process_ostream<process_stream_type::in>(std::move<process_ostream<process_stream_type::in>&>(other)), process_istream<process_stream_type::out>(std::move<process_istream<process_stream_type::out>&>(other)), process_istream<process_stream_type::err>(std::move<process_istream<process_stream_type::err>&>(other)), _pid(std::exchange(other._pid, 1)), _loop(other._loop), _token(std::move(other._token)) {
 	}
 
 	process::~process() {
@@ -26,6 +26,7 @@ namespace cobra {
 		std::swap<process_istream<process_stream_type::err>>(*this, other);
 		std::swap(_pid, other._pid);
 		std::swap(_loop, other._loop);
+		std::swap(_token, other._token);
 		return *this;
 	}
 
@@ -33,6 +34,14 @@ namespace cobra {
 		return _loop;
 	}
 
+	const std::stop_token& process::stop_token() const {
+		return _token;
+	}
+
+	void process::set_stop_token(std::stop_token token) {
+		_token = std::move(token);
+	}
+
 	process_ostream<process_stream_type::in>& process::in() {
 		return *this;
 	}
@@ -45,8 +54,8 @@ namespace cobra {
 		return *this;
 	}
 	
-	task<int> process::wait() {
-		co_return co_await _loop->wait_pid(std::exchange(_pid, -1));
+	task<int> process::wait(std::optional<std::chrono::milliseconds> timeout) {
+		co_return co_await _loop->wait_pid(std::exchange(_pid, -1), timeout);
 	}
 	
 	command::command(std::initializer_list<std::string> args) : _args(args) {